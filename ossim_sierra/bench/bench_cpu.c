@@ -0,0 +1,76 @@
+/*
+ * Interpreter benchmark
+ * Measures instructions per second of the CPU on a long calc-only
+ * program, built by repeating a process description (input/proc/s0 by
+ * default). "step" runs one instruction per call as a CPU does with
+ * one instruction per slot; "slice N" runs N instructions per call.
+ *
+ * Usage: bench_cpu [process description] [instructions]
+ */
+
+#include "cpu.h"
+#include "loader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now_sec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char * name, long count, double elapsed) {
+	fprintf(stderr, "%12s %12ld %12.3f %14.0f\n", name, count, elapsed, count / elapsed);
+}
+
+int main(int argc, char * argv[]) {
+	const char * path = (argc > 1) ? argv[1] : "input/proc/s0";
+	long total = (argc > 2) ? atol(argv[2]) : 20000000;
+
+	struct pcb_t * proc = load(path);
+	struct code_seg_t * code = proc->code;
+	for (uint32_t i = 0; i < code->size; i++) {
+		if (code->text[i].opcode != CALC) {
+			fprintf(stderr, "%s: only calc programs can run outside the simulator\n", path);
+			return 1;
+		}
+	}
+
+	/* Repeat the program up to about a million instructions */
+	uint32_t reps = (1 << 20) / code->size + 1;
+	struct inst_t * text = malloc(sizeof(struct inst_t) * code->size * reps);
+	for (uint32_t r = 0; r < reps; r++) {
+		memcpy(text + r * code->size, code->text, sizeof(struct inst_t) * code->size);
+	}
+	free(code->decoded);
+	code->text = text;
+	code->size *= reps;
+	decode_code(code);
+
+	fprintf(stderr, "%12s %12s %12s %14s\n", "mode", "instructions", "seconds", "ins/sec");
+
+	long done = 0;
+	double start = now_sec();
+	while (done < total) {
+		if (proc->pc == code->size) proc->pc = 0;
+		run(proc);
+		done++;
+	}
+	report("step", done, now_sec() - start);
+
+	for (int slice = 1; slice <= 4096; slice *= 16) {
+		char name[32];
+		snprintf(name, sizeof(name), "slice %d", slice);
+		done = 0;
+		proc->pc = 0;
+		start = now_sec();
+		while (done < total) {
+			if (proc->pc == code->size) proc->pc = 0;
+			done += run_slice(proc, slice);
+		}
+		report(name, done, now_sec() - start);
+	}
+	return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * Frame allocator benchmark
+ * Formats a RAM and the swap devices, then moves frames in and out of
+ * their free pools the way page faults and process exits do, from one
+ * and from several threads. Checks that no frame is handed out twice.
+ * Then copies pages between the devices byte by byte, as swapping used
+ * to, and a page at a time, to a random access and a sequential device
+ * of the same size. For the sequential one it reports the cursor travel
+ * and the simulated time, in instructions, each page costs. Last, the
+ * same copies to a swap file, buffered and O_DIRECT, to scattered slots
+ * and to adjacent ones that go out as runs, with the host I/O per page.
+ *
+ * Usage: bench_memphy [swap MB] [operations] [threads]
+ */
+
+#include "mm.h"
+#include "os-cfg.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RAM_SIZE	(2 << 20)
+#define HELD		64	/* Frames a worker holds at a time */
+
+static double now_sec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long peak_rss_kb(void) {
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_maxrss;
+}
+
+struct worker_t {
+	struct memphy_struct * mp;
+	long ops;
+	int * owner;	/* Frame -> worker holding it + 1, for the check */
+	int id;
+	int bad;
+};
+
+/* Take a frame and give back the oldest one held, as a fault does with
+ * a swap slot, then give back everything at once as an exit does */
+static void * churn(void * arg) {
+	struct worker_t * w = (struct worker_t *)arg;
+	int held[HELD];
+	int nr_held = 0, oldest = 0;
+	for (long i = 0; i < w->ops; i++) {
+		int fpn;
+		if (MEMPHY_get_freefp(w->mp, &fpn) != 0) break;
+		if (__atomic_exchange_n(&w->owner[fpn], w->id + 1, __ATOMIC_RELAXED) != 0) w->bad++;
+		if (nr_held < HELD) {
+			held[nr_held++] = fpn;
+			continue;
+		}
+		__atomic_store_n(&w->owner[held[oldest]], 0, __ATOMIC_RELAXED);
+		MEMPHY_put_freefp(w->mp, held[oldest]);
+		held[oldest] = fpn;
+		oldest = (oldest + 1) % HELD;
+	}
+	for (int i = 0; i < nr_held; i++) {
+		__atomic_store_n(&w->owner[held[i]], 0, __ATOMIC_RELAXED);
+	}
+	MEMPHY_put_freefps(w->mp, held, nr_held);
+	return NULL;
+}
+
+static int bench_churn(const char * name, struct memphy_struct * mp, long ops, int nthreads) {
+	int nr_frames = mp->maxsz / PAGING_PAGESZ;
+	int * owner = calloc(nr_frames, sizeof(int));
+	pthread_t * threads = malloc(sizeof(pthread_t) * nthreads);
+	struct worker_t * workers = malloc(sizeof(struct worker_t) * nthreads);
+
+	double start = now_sec();
+	for (int i = 0; i < nthreads; i++) {
+		workers[i] = (struct worker_t){ mp, ops / nthreads, owner, i, 0 };
+		pthread_create(&threads[i], NULL, churn, &workers[i]);
+	}
+	int bad = 0;
+	for (int i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+		bad += workers[i].bad;
+	}
+	double elapsed = now_sec() - start;
+
+	fprintf(stderr, "%16s %8d %12ld %12.3f %14.0f\n", name, nthreads, ops, elapsed, ops / elapsed);
+	if (bad > 0 || mp->nr_free_fp != nr_frames) {
+		fprintf(stderr, "%s: %d frames handed out twice, %d of %d free at the end\n",
+			name, bad, mp->nr_free_fp, nr_frames);
+		bad++;
+	}
+	free(owner);
+	free(threads);
+	free(workers);
+	return bad;
+}
+
+/* Copy [ops] pages from RAM to every [stride]th frame of [dst] and check
+ * the last one landed */
+static int bench_copy(const char * name, struct memphy_struct * ram,
+		struct memphy_struct * dst, long ops, int bytewise, long stride) {
+	int nr_ram = ram->maxsz / PAGING_PAGESZ, nr_dst = dst->maxsz / PAGING_PAGESZ;
+	for (int i = 0; i < PAGING_PAGESZ; i++) {
+		MEMPHY_write(ram, (nr_ram - 1) * PAGING_PAGESZ + i, (BYTE)i);
+	}
+	unsigned long seek = dst->seek_bytes, io_ops = dst->io_ops;
+	long cost = 0;
+
+	double start = now_sec();
+	for (long i = 0; i < ops; i++) {
+		int src = (i * 7919) % nr_ram, to = (i * stride) % nr_dst;
+		if (i == ops - 1) src = nr_ram - 1;
+		if (!bytewise) {
+			cost += MEMPHY_copy_page(ram, src, dst, to);
+			continue;
+		}
+		for (int c = 0; c < PAGING_PAGESZ; c++) {
+			BYTE data;
+			MEMPHY_read(ram, src * PAGING_PAGESZ + c, &data);
+			MEMPHY_write(dst, to * PAGING_PAGESZ + c, data);
+		}
+	}
+	MEMPHY_sync(dst);
+	double elapsed = now_sec() - start;
+
+	fprintf(stderr, "%16s %8d %12ld %12.3f %14.0f", name, 1, ops, elapsed, ops / elapsed);
+	if (!dst->rdmflg) {
+		fprintf(stderr, "  %.0f seek bytes/page, %.1f ins/page",
+			(double)(dst->seek_bytes - seek) / ops, cost / 1000.0 / ops);
+	}
+	if (dst->fd >= 0) {
+		fprintf(stderr, "  %.3f host I/O/page", (double)(dst->io_ops - io_ops) / ops);
+	}
+	fprintf(stderr, "\n");
+
+	BYTE page[PAGING_PAGESZ];
+	MEMPHY_read_page(dst, ((ops - 1) * stride) % nr_dst, page);
+	for (int i = 0; i < PAGING_PAGESZ; i++) {
+		if (page[i] != (BYTE)i) {
+			fprintf(stderr, "%s: byte %d of the last page is wrong\n", name, i);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char * argv[]) {
+	long swap_mb = (argc > 1) ? atol(argv[1]) : 512;
+	long ops = (argc > 2) ? atol(argv[2]) : 20000000;
+	int nthreads = (argc > 3) ? atoi(argv[3]) : 4;
+
+	/* A RAM and every swap device, as os formats them */
+	struct memphy_struct ram, swap, spare[PAGING_MAX_MMSWP - 1];
+	long rss = peak_rss_kb();
+	double start = now_sec();
+	init_memphy(&ram, RAM_SIZE, 1);
+	init_memphy(&swap, swap_mb << 20, 1);
+	for (int i = 0; i < PAGING_MAX_MMSWP - 1; i++) init_memphy(&spare[i], swap_mb << 20, 1);
+	double elapsed = now_sec() - start;
+	fprintf(stderr, "format: %d + %d x %d frames in %.3f ms, %ld KB\n",
+		RAM_SIZE / PAGING_PAGESZ, PAGING_MAX_MMSWP, (int)((swap_mb << 20) / PAGING_PAGESZ),
+		elapsed * 1e3, peak_rss_kb() - rss);
+
+	fprintf(stderr, "%16s %8s %12s %12s %14s\n", "mode", "threads", "ops", "seconds", "ops/sec");
+	int bad = 0;
+	bad += bench_churn("ram", &ram, ops, 1);
+	bad += bench_churn("swap", &swap, ops, 1);
+	bad += bench_churn("swap contended", &swap, ops, nthreads);
+
+	struct memphy_struct seq;
+	init_memphy(&seq, swap_mb << 20, 0);
+	MEMPHY_set_cost(&seq, MEMSWP_SEEK_COST, MEMSWP_XFER_COST);
+	long pages = ops / 20;
+	bad += bench_copy("copy bytewise", &ram, &swap, pages, 1, 104729);
+	bad += bench_copy("copy page", &ram, &swap, pages, 0, 104729);
+	bad += bench_copy("copy page seq", &ram, &seq, pages, 0, 104729);
+
+	const char * tmp = getenv("TMPDIR");
+	char path[256];
+	snprintf(path, sizeof(path), "%s/bench_memphy.%d", tmp ? tmp : "/tmp", (int)getpid());
+	for (int direct = 0; direct <= 1; direct++) {
+		struct memphy_struct file;
+		if (init_memphy_file(&file, swap_mb << 20, 1, path, direct) != 0) {
+			fprintf(stderr, "%16s cannot open %s\n", direct ? "file direct" : "file", path);
+			continue;
+		}
+		bad += bench_copy(direct ? "direct scattered" : "file scattered", &ram, &file,
+			pages / 10, 0, 104729);
+		bad += bench_copy(direct ? "direct runs" : "file runs", &ram, &file,
+			pages / 10, 0, 1);
+		MEMPHY_release(&file);
+	}
+	unlink(path);
+	return bad ? 1 : 0;
+}
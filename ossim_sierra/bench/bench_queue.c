@@ -0,0 +1,102 @@
+/*
+ * Queue stress benchmark
+ * Pushes a large number of processes through a single queue_t and then
+ * through the MLQ scheduler spread over all priority levels and a few
+ * CPUs, checking that every process comes out exactly once and in FIFO
+ * order within its level. Every process the scheduler hands out is
+ * finished at once.
+ *
+ * Usage: bench_queue [processes] [cpus]
+ */
+
+#include "queue.h"
+#include "sched.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double now_sec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int bench_fifo(struct pcb_t * procs, int nprocs) {
+	struct queue_t q;
+	queue_init(&q, NULL, 0);
+
+	double start = now_sec();
+	for (int i = 0; i < nprocs; i++) {
+		enqueue(&q, &procs[i]);
+	}
+	for (int i = 0; i < nprocs; i++) {
+		if (dequeue(&q) != &procs[i]) {
+			fprintf(stderr, "fifo: process %d out of order\n", i + 1);
+			return 1;
+		}
+	}
+	double elapsed = now_sec() - start;
+
+	fprintf(stderr, "%8s %8d %12.3f %14.0f\n",
+		"fifo", nprocs, elapsed, 2 * nprocs / elapsed);
+	queue_free(&q);
+	return 0;
+}
+
+static int bench_sched(struct pcb_t * procs, int nprocs, int ncpus) {
+	int * last = malloc(sizeof(int) * MAX_PRIO);
+	int seen = 0;
+
+	for (int i = 0; i < MAX_PRIO; i++) last[i] = -1;
+	init_scheduler(ncpus, SCHED_MLQ);
+	/* Time dispatch and finish, not the share report */
+	sched_record_shares(0);
+
+	double start = now_sec();
+	for (int i = 0; i < nprocs; i++) {
+		procs[i].prio = i % MAX_PRIO;
+		add_proc(&procs[i]);
+	}
+	for (int cpu = 0; seen < nprocs; cpu = (cpu + 1) % ncpus) {
+		struct pcb_t * proc = get_proc(cpu);
+		if (proc == NULL) break;
+		finish_proc(cpu, proc);
+		seen++;
+		/* Processes of one level on one CPU leave in arrival order */
+		if (ncpus == 1) {
+			int idx = proc - procs;
+			if (idx <= last[proc->prio]) {
+				fprintf(stderr, "sched: process %d out of order\n", idx + 1);
+				return 1;
+			}
+			last[proc->prio] = idx;
+		}
+	}
+	double elapsed = now_sec() - start;
+
+	if (seen != nprocs || queue_empty() != 1 || live_procs() != 0) {
+		fprintf(stderr, "sched: %d of %d processes came out\n", seen, nprocs);
+		return 1;
+	}
+	fprintf(stderr, "%8s %8d %12.3f %14.0f\n",
+		"sched", nprocs, elapsed, 2 * nprocs / elapsed);
+	finish_scheduler();
+	free(last);
+	return 0;
+}
+
+int main(int argc, char * argv[]) {
+	int nprocs = (argc > 1) ? atoi(argv[1]) : 100000;
+	int ncpus = (argc > 2) ? atoi(argv[2]) : 4;
+	struct pcb_t * procs = calloc(nprocs, sizeof(struct pcb_t));
+
+	for (int i = 0; i < nprocs; i++) {
+		procs[i].pid = i + 1;
+	}
+	fprintf(stderr, "%8s %8s %12s %14s\n", "queue", "procs", "seconds", "ops/sec");
+	if (bench_fifo(procs, nprocs) != 0) return 1;
+	if (bench_sched(procs, nprocs, 1) != 0) return 1;
+	if (bench_sched(procs, nprocs, ncpus) != 0) return 1;
+	free(procs);
+	return 0;
+}
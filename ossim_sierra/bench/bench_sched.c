@@ -0,0 +1,59 @@
+/*
+ * Scheduler benchmark
+ * Measures get_proc()/put_proc() round trips per second on one CPU run
+ * queue. "spread" keeps one process on every priority level, "tail"
+ * keeps them all on the lowest priority level so that every pick has
+ * to skip the empty levels above it. The CFS rows run the same spread
+ * with a growing number of processes in the vruntime heap.
+ *
+ * Usage: bench_sched [round trips]
+ */
+
+#include "sched.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double now_sec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run_bench(const char * name, enum sched_policy_t policy,
+		int nprocs, int spread, long iters) {
+	struct pcb_t * procs = calloc(nprocs, sizeof(struct pcb_t));
+
+	init_scheduler(1, policy);
+	for (int i = 0; i < nprocs; i++) {
+		procs[i].pid = i + 1;
+		procs[i].prio = spread ? (i % MAX_PRIO) : MAX_PRIO - 1;
+		add_proc(&procs[i]);
+	}
+
+	double start = now_sec();
+	for (long i = 0; i < iters; i++) {
+		struct pcb_t * proc = get_proc(0);
+		proc->run_slots++;
+		put_proc(0, proc);
+	}
+	double elapsed = now_sec() - start;
+
+	fprintf(stderr, "%8s %8d %10ld %12.3f %14.0f\n",
+		name, nprocs, iters, elapsed, iters / elapsed);
+	finish_scheduler();
+	free(procs);
+}
+
+int main(int argc, char * argv[]) {
+	long iters = (argc > 1) ? atol(argv[1]) : 2000000;
+
+	fprintf(stderr, "%8s %8s %10s %12s %14s\n",
+		"layout", "procs", "picks", "seconds", "picks/sec");
+	run_bench("spread", SCHED_MLQ, MAX_PRIO, 1, iters);
+	run_bench("tail", SCHED_MLQ, 1, 0, iters);
+	for (int nprocs = MAX_PRIO; nprocs <= 100 * MAX_PRIO; nprocs *= 10) {
+		run_bench("cfs", SCHED_CFS, nprocs, 1, iters);
+	}
+	return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * Slot barrier benchmark
+ * Measures how many simulated time slots per second the timer can drive
+ * for a growing number of attached devices. Every device does nothing
+ * but next_slot(), so the figure is the pure synchronization cost.
+ *
+ * Usage: bench_timer [slots] [max devices]
+ */
+
+#include "timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static int num_slots;
+
+static void * dev_routine(void * args) {
+	struct timer_id_t * timer_id = (struct timer_id_t *)args;
+	for (int i = 0; i < num_slots; i++) {
+		next_slot(timer_id);
+	}
+	detach_event(timer_id);
+	pthread_exit(NULL);
+}
+
+static double now_sec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Run one configuration. The timer keeps its state in statics, so
+ * every configuration gets a fresh process */
+static void run_bench(int ndevs) {
+	pthread_t * dev = malloc(sizeof(pthread_t) * ndevs);
+	struct timer_id_t ** ids = malloc(sizeof(struct timer_id_t *) * ndevs);
+
+	/* Keep the "Time slot" trace out of the measurement output */
+	int devnull = open("/dev/null", O_WRONLY);
+	dup2(devnull, STDOUT_FILENO);
+
+	for (int i = 0; i < ndevs; i++) {
+		ids[i] = attach_event();
+	}
+	double start = now_sec();
+	start_timer();
+	for (int i = 0; i < ndevs; i++) {
+		pthread_create(&dev[i], NULL, dev_routine, ids[i]);
+	}
+	for (int i = 0; i < ndevs; i++) {
+		pthread_join(dev[i], NULL);
+	}
+	stop_timer();
+	double elapsed = now_sec() - start;
+
+	fprintf(stderr, "%8d %10d %12.3f %14.0f\n",
+		ndevs, num_slots, elapsed, num_slots / elapsed);
+	free(ids);
+	free(dev);
+}
+
+int main(int argc, char * argv[]) {
+	num_slots = (argc > 1) ? atoi(argv[1]) : 20000;
+	int max_devs = (argc > 2) ? atoi(argv[2]) : 64;
+
+	fprintf(stderr, "%8s %10s %12s %14s\n",
+		"devices", "slots", "seconds", "slots/sec");
+	for (int ndevs = 1; ndevs <= max_devs; ndevs *= 2) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			run_bench(ndevs);
+			exit(0);
+		}
+		waitpid(pid, NULL, 0);
+	}
+	return 0;
+}
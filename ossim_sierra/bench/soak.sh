@@ -0,0 +1,70 @@
+#!/bin/sh
+# Soak test, run from the simulator directory by `make soak`. Streams a
+# long run of short-lived processes that allocate and free memory
+# through the simulator, with the odd killall cutting some of them
+# short, and samples its resident set size once a second. Memory is flat when every exit gives back what the process
+# held: the second half of the run must not outgrow the first. Prints
+# one JSON object per sample, then the statistics of `os -j` with the
+# verdict added.
+#
+# Usage: bench/soak.sh [-e engine] [-n processes] [-o results file]
+#                      [-- wlgen options]
+
+ENGINE=des
+NPROCS=1000000
+OUT=/dev/stdout
+while getopts "e:n:o:" opt; do
+	case $opt in
+	e) ENGINE=$OPTARG ;;
+	n) NPROCS=$OPTARG ;;
+	o) OUT=$OPTARG ;;
+	*) sed -n 's/^# \{0,1\}//p' "$0" | sed -n '/^Usage/,$p'; exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/ossim-soak.XXXXXX")
+trap 'rm -rf "$WORK"' EXIT
+STATS=$WORK/stats.jsonl
+
+# Arrivals come slower than 4 CPUs retire 12-instruction processes, so
+# the number of live processes stays bounded. A killall spells out its
+# program path a byte at a time, which the wider span makes room for
+./bench/wlgen -o "$WORK/wl" -n "$NPROCS" -c 4 -t 2 -p 16 -l 12 \
+	-m calc=100,alloc=60,free=39,kill=1 -a 64-2048 -d uniform:$((NPROCS * 6)) \
+	-R 1048576 -S 16777216 "$@" || exit 1
+
+./os -e "$ENGINE" -j "$STATS" "$WORK/wl/config" > /dev/null 2> /dev/null &
+pid=$!
+t=0
+: > "$WORK/rss"
+while kill -0 $pid 2> /dev/null; do
+	rss=$(sed -n 's/^VmRSS:[^0-9]*\([0-9]*\).*/\1/p' /proc/$pid/status 2> /dev/null)
+	if [ -n "$rss" ]; then
+		echo "$rss" >> "$WORK/rss"
+		echo "{\"soak_s\": $t, \"rss_kb\": $rss}" >> "$OUT"
+	fi
+	sleep 1
+	t=$((t + 1))
+done
+wait $pid
+rc=$?
+
+if [ ! -s "$STATS" ]; then
+	echo "{\"soak\": \"failed\", \"exit\": $rc}" >> "$OUT"
+	exit 1
+fi
+# Peak of each half of the samples, the first one left out as warmup
+verdict=$(awk '{ rss[NR] = $1 }
+	END {
+		half = int((NR + 1) / 2)
+		for (i = 2; i <= NR; i++) {
+			if (i <= half) { if (rss[i] > first) first = rss[i] }
+			else if (rss[i] > second) second = rss[i]
+		}
+		flat = (second <= first * 1.1 + 1024) ? "true" : "false"
+		printf "\"rss_first_half_kb\": %d, \"rss_second_half_kb\": %d, \"flat\": %s",
+			first, second, flat
+	}' "$WORK/rss")
+sed "s/^{/{\"soak\": \"$ENGINE\", $verdict, /" "$STATS" >> "$OUT"
+echo "$verdict" | grep -q '"flat": true'
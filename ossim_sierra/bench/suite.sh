@@ -0,0 +1,70 @@
+#!/bin/sh
+# End-to-end benchmark suite, run from the simulator directory by
+# `make suite`. First checks every engine against the reference traces
+# in output/, then generates workloads with bench/wlgen and runs them
+# on every engine. Prints one JSON object per line: "check" lines for
+# the reference traces and the statistics of `os -j` for the runs.
+#
+# Usage: bench/suite.sh [-e "engines"] [-i instructions per slot]
+#                       [-o results file] [-- wlgen options]
+# With wlgen options only that workload is run instead of the default set.
+
+ENGINES="des pool threaded"
+INS=1
+OUT=/dev/stdout
+while getopts "e:i:o:" opt; do
+	case $opt in
+	e) ENGINES=$OPTARG ;;
+	i) INS=$OPTARG ;;
+	o) OUT=$OPTARG ;;
+	*) sed -n 's/^# \{0,1\}//p' "$0" | sed -n '/^Usage/,$p'; exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/ossim-suite.XXXXXX")
+trap 'rm -rf "$WORK"' EXIT
+STATS=$WORK/stats.jsonl
+
+# Reference traces. Only the event lines are compared: the reference
+# files use CRLF line ends. The threaded engine is not deterministic.
+for ref in output/*.output; do
+	cfg=$(basename "$ref" .output)
+	[ -f "input/$cfg" ] || continue
+	tr -d '\r' < "$ref" > "$WORK/ref"
+	for engine in $ENGINES; do
+		timeout 20 ./os -e "$engine" "$cfg" > "$WORK/out" 2> /dev/null
+		rc=$?
+		lines=$(diff "$WORK/out" "$WORK/ref" | grep -c '^[<>]')
+		match=false
+		[ "$lines" -eq 0 ] && match=true
+		echo "{\"check\": \"$cfg\", \"engine\": \"$engine\", \"exit\": $rc," \
+			"\"match\": $match, \"diff_lines\": $lines}" >> "$OUT"
+	done
+done
+
+run_workload() {
+	name=$1
+	shift
+	dir=$WORK/$name
+	./bench/wlgen -o "$dir" "$@" || exit 1
+	for engine in $ENGINES; do
+		rm -f "$STATS"
+		timeout 600 ./os -e "$engine" -i "$INS" -j "$STATS" "$dir/config" \
+			> /dev/null 2> /dev/null
+		if [ -s "$STATS" ]; then
+			sed "s/^{/{\"workload\": \"$name\", /" "$STATS" >> "$OUT"
+		else
+			echo "{\"workload\": \"$name\", \"engine\": \"$engine\", \"failed\": true}" >> "$OUT"
+		fi
+	done
+}
+
+if [ $# -gt 0 ]; then
+	run_workload custom "$@"
+else
+	run_workload cpu -n 200 -c 4 -l 2000 -m calc=1 -d poisson:2
+	run_workload mem -n 50 -c 4 -l 200 -d poisson:2 -R 1048576 -S 16777216
+	run_workload small_ram -n 50 -c 2 -l 200 -d burst:10:20 -R 16384 -S 1048576
+	run_workload many -n 5000 -c 8 -p 64 -l 20 -m calc=1 -d uniform:2000
+fi
@@ -0,0 +1,75 @@
+#!/bin/sh
+# Swap backend benchmark, run from the simulator directory by
+# `make swapbench`. Runs swap-heavy configurations with their first
+# swap in memory, in a host file and in a host file opened O_DIRECT,
+# and checks every backend gives the trace of the in-memory one. Prints
+# the statistics of `os -j` with the workload, the backend and the
+# verdict added, one JSON object per run.
+#
+# Usage: bench/swap.sh [-b "backends"] [-e engine] [-d swap file dir]
+#                      [-o results file] [configs]
+# O_DIRECT needs a file system that supports it, tmpfs does not.
+
+BACKENDS="mem file direct"
+ENGINE=des
+OUT=/dev/stdout
+SWAPDIR=
+while getopts "b:e:d:o:" opt; do
+	case $opt in
+	b) BACKENDS=$OPTARG ;;
+	e) ENGINE=$OPTARG ;;
+	d) SWAPDIR=$OPTARG ;;
+	o) OUT=$OPTARG ;;
+	*) sed -n 's/^# \{0,1\}//p' "$0" | sed -n '/^Usage/,$p'; exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/ossim-swap.XXXXXX")
+trap 'rm -rf "$WORK"' EXIT
+STATS=$WORK/stats.jsonl
+SWAPFILE=${SWAPDIR:-$WORK}/ossim-swap.$$
+
+# Run [config] on every backend. The memory line is the second line of
+# the configuration, its second field the first swap
+run_config() {
+	name=$1
+	cfg=$2
+	for backend in $BACKENDS; do
+		case $backend in
+		mem) spec= ;;
+		file) spec="@$SWAPFILE" ;;
+		direct) spec="@$SWAPFILE,direct" ;;
+		*) echo "unknown backend $backend" >&2; exit 1 ;;
+		esac
+		sed "2s|^\([0-9]*\)[ 	]*\([0-9]*\)|\1 \2$spec|" "$cfg" > "$WORK/config"
+		rm -f "$STATS"
+		timeout 600 ./os -e "$ENGINE" -j "$STATS" "$WORK/config" \
+			> "$WORK/out.$backend" 2> /dev/null
+		rm -f "$SWAPFILE"
+		match=true
+		if [ -f "$WORK/out.mem" ] && ! cmp -s "$WORK/out.mem" "$WORK/out.$backend"; then
+			match=false
+		fi
+		if [ -s "$STATS" ]; then
+			sed "s/^{/{\"workload\": \"$name\", \"backend\": \"$backend\", \"match\": $match, /" \
+				"$STATS" >> "$OUT"
+		else
+			echo "{\"workload\": \"$name\", \"backend\": \"$backend\", \"failed\": true}" >> "$OUT"
+		fi
+	done
+	rm -f "$WORK"/out.*
+}
+
+if [ $# -gt 0 ]; then
+	for cfg in "$@"; do
+		run_config "$(basename "$cfg")" "$cfg"
+	done
+else
+	run_config os_1_mlq_paging_small_1K input/os_1_mlq_paging_small_1K
+	run_config os_1_mlq_paging_small_4K input/os_1_mlq_paging_small_4K
+	./bench/wlgen -o "$WORK/wl" -n 32 -c 4 -l 1000 \
+		-m calc=10,alloc=15,free=2,read=35,write=38 -a 4096-16384 \
+		-d poisson:4 -R 65536 -S 67108864 || exit 1
+	run_config swap_heavy "$WORK/wl/config"
+fi
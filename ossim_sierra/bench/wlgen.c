@@ -0,0 +1,253 @@
+/*
+ * Workload generator
+ * Writes a configuration and the programs it runs into a directory,
+ * for the benchmark suite (bench/suite.sh) or by hand. Programs only
+ * free, read and write regions they have allocated.
+ *
+ * Usage: wlgen -o <dir> [-n processes] [-c cpus] [-t time slot]
+ *              [-p programs] [-l instructions] [-m mix] [-a min-max]
+ *              [-d arrivals] [-R ram] [-S swap] [-s seed]
+ *
+ *   -m  instruction weights, e.g. calc=60,alloc=10,free=5,read=10,write=15
+ *       kill=<w> writes the path of a random program into a region of
+ *       its own and calls killall on it, length of the path + 3
+ *       instructions where the others are one
+ *   -a  allocation sizes in bytes
+ *   -d  uniform:<span>       start times spread over <span> slots
+ *       poisson:<mean gap>   exponential gaps between arrivals
+ *       burst:<size>:<gap>   <size> arrivals every <gap> slots
+ *   -R/-S  RAM and first swap size for the second configuration line
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define NR_REGS	10	/* Registers a program can allocate into */
+
+enum { CALC, ALLOC, FREE, READ, WRITE, KILL, NR_OPS };
+static const char * op_names[NR_OPS] = { "calc", "alloc", "free", "read", "write", "kill" };
+
+#define SYS_KILLALL	101
+
+static unsigned long long rnd_state = 88172645463325252ull;
+
+static unsigned long long rnd(void) {
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state;
+}
+
+static unsigned long rnd_range(unsigned long lo, unsigned long hi) {
+	return lo + rnd() % (hi - lo + 1);
+}
+
+static double rnd_unit(void) {
+	return (rnd() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void usage(void) {
+	printf("Usage: wlgen -o <dir> [-n processes] [-c cpus] [-t time slot]"
+		" [-p programs] [-l instructions] [-m mix] [-a min-max]"
+		" [-d uniform:<span>|poisson:<mean gap>|burst:<size>:<gap>]"
+		" [-R ram] [-S swap] [-s seed]\n");
+}
+
+static int parse_mix(char * spec, unsigned int * weight) {
+	memset(weight, 0, sizeof(unsigned int) * NR_OPS);
+	for (char * tok = strtok(spec, ","); tok != NULL; tok = strtok(NULL, ",")) {
+		char * eq = strchr(tok, '=');
+		if (eq == NULL) return -1;
+		*eq = '\0';
+		int op;
+		for (op = 0; op < NR_OPS && strcmp(tok, op_names[op]) != 0; op++)
+			;
+		if (op == NR_OPS) return -1;
+		weight[op] = atoi(eq + 1);
+	}
+	return 0;
+}
+
+static int pick_op(const unsigned int * weight, unsigned int total) {
+	unsigned int r = rnd() % total;
+	int op = 0;
+	while (r >= weight[op]) {
+		r -= weight[op];
+		op++;
+	}
+	return op;
+}
+
+static void write_program(const char * path, int length, const unsigned int * weight,
+		unsigned int total, unsigned int amin, unsigned int amax,
+		const char * dir, int nr_progs) {
+	FILE * file;
+	if ((file = fopen(path, "w")) == NULL) {
+		printf("Cannot write program at %s\n", path);
+		exit(1);
+	}
+	unsigned int size[NR_REGS] = { 0 };	/* 0: not allocated */
+	int nr_alloc = 0;
+	/* A kill is several instructions, the count is known at the end */
+	char * text;
+	size_t text_len;
+	FILE * body = open_memstream(&text, &text_len);
+	int nr_ins = 0;
+
+	int prio = (int)rnd_range(0, 139);
+	for (int i = 0; i < length; i++) {
+		int op = (total == 0) ? CALC : pick_op(weight, total);
+		int reg = rnd() % NR_REGS;
+		if (op == FREE || op == READ || op == WRITE) {
+			/* Only on a region the program holds, if there is none
+			 * it allocates one instead */
+			if (nr_alloc > 0) {
+				while (size[reg] == 0) reg = rnd() % NR_REGS;
+			}else{
+				op = ALLOC;
+			}
+		}
+
+		char victim[128];
+		int vlen;
+		switch (op) {
+		case CALC:
+			fprintf(body, "calc\n");
+			break;
+		case ALLOC:
+			if (size[reg] == 0) nr_alloc++;
+			size[reg] = rnd_range(amin, amax);
+			fprintf(body, "alloc %u %d\n", size[reg], reg);
+			break;
+		case FREE:
+			fprintf(body, "free %d\n", reg);
+			size[reg] = 0;
+			nr_alloc--;
+			break;
+		case READ:
+			fprintf(body, "read %d %u %d\n", reg, (unsigned int)(rnd() % size[reg]), (int)(rnd() % NR_REGS));
+			break;
+		case WRITE:
+			fprintf(body, "write %u %d %u\n", (unsigned int)(rnd() % 256), reg, (unsigned int)(rnd() % size[reg]));
+			break;
+		case KILL:
+			/* killall reads the name up to a byte of -1, 99 bytes at most */
+			vlen = snprintf(victim, sizeof(victim), "%s/prog_%lu", dir,
+				(unsigned long)(rnd() % nr_progs));
+			if (vlen > 99) {
+				printf("Program paths in %s are too long to kill\n", dir);
+				exit(1);
+			}
+			if (size[reg] == 0) nr_alloc++;
+			size[reg] = vlen + 1;
+			fprintf(body, "alloc %d %d\n", vlen + 1, reg);
+			for (int c = 0; c < vlen; c++) {
+				fprintf(body, "write %u %d %d\n", (unsigned char)victim[c], reg, c);
+			}
+			fprintf(body, "write -1 %d %d\n", reg, vlen);
+			fprintf(body, "syscall %d %d\n", SYS_KILLALL, reg);
+			nr_ins += vlen + 2;
+			break;
+		}
+		nr_ins++;
+	}
+	fclose(body);
+	fprintf(file, "%d %d\n", prio, nr_ins);
+	fwrite(text, 1, text_len, file);
+	free(text);
+	fclose(file);
+}
+
+int main(int argc, char * argv[]) {
+	const char * dir = NULL;
+	int nr_procs = 100, nr_cpus = 4, time_slot = 2, nr_progs = 16, length = 200;
+	unsigned int amin = 64, amax = 1024;
+	long ram = 1048576, swap = 16777216;
+	char mix[128] = "calc=60,alloc=10,free=5,read=10,write=15";
+	char arrivals[64] = "poisson:1";
+	int opt;
+
+	while ((opt = getopt(argc, argv, "o:n:c:t:p:l:m:a:d:R:S:s:")) != -1) {
+		switch (opt) {
+		case 'o': dir = optarg; break;
+		case 'n': nr_procs = atoi(optarg); break;
+		case 'c': nr_cpus = atoi(optarg); break;
+		case 't': time_slot = atoi(optarg); break;
+		case 'p': nr_progs = atoi(optarg); break;
+		case 'l': length = atoi(optarg); break;
+		case 'm': snprintf(mix, sizeof(mix), "%s", optarg); break;
+		case 'a':
+			if (sscanf(optarg, "%u-%u", &amin, &amax) != 2 || amin == 0 || amin > amax) {
+				usage();
+				return 1;
+			}
+			break;
+		case 'd': snprintf(arrivals, sizeof(arrivals), "%s", optarg); break;
+		case 'R': ram = atol(optarg); break;
+		case 'S': swap = atol(optarg); break;
+		case 's': rnd_state = strtoull(optarg, NULL, 10) * 2654435761ull + 1; break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	unsigned int weight[NR_OPS];
+	if (dir == NULL || nr_procs < 0 || nr_cpus < 1 || nr_progs < 1 || length < 1 ||
+	    parse_mix(mix, weight) != 0) {
+		usage();
+		return 1;
+	}
+	unsigned int total = 0;
+	for (int op = 0; op < NR_OPS; op++) total += weight[op];
+
+	mkdir(dir, 0755);
+	size_t plen = strlen(dir) + 32;
+	char * path = malloc(plen);
+	for (int i = 0; i < nr_progs; i++) {
+		snprintf(path, plen, "%s/prog_%d", dir, i);
+		write_program(path, length, weight, total, amin, amax, dir, nr_progs);
+	}
+
+	snprintf(path, plen, "%s/config", dir);
+	FILE * file;
+	if ((file = fopen(path, "w")) == NULL) {
+		printf("Cannot write configuration at %s\n", path);
+		return 1;
+	}
+	fprintf(file, "%d %d %d\n", time_slot, nr_cpus, nr_procs);
+	fprintf(file, "%ld %ld 0 0 0\n", ram, swap);
+
+	double t = 0;
+	unsigned long span = 0, size = 0, gap = 0;
+	double mean = 0;
+	if (sscanf(arrivals, "uniform:%lu", &span) == 1) {
+		/* Sorted start times, as exponential gaps of span / (n + 1) on average */
+		for (int i = 0; i < nr_procs; i++) {
+			t += -log(1.0 - rnd_unit()) * span / (nr_procs + 1);
+			if (t >= span) t = span - 1;
+			fprintf(file, "%lu %s/prog_%lu %lu\n", (unsigned long)t, dir,
+				(unsigned long)(rnd() % nr_progs), rnd_range(0, 139));
+		}
+	}else if (sscanf(arrivals, "poisson:%lf", &mean) == 1) {
+		for (int i = 0; i < nr_procs; i++) {
+			fprintf(file, "%lu %s/prog_%lu %lu\n", (unsigned long)t, dir,
+				(unsigned long)(rnd() % nr_progs), rnd_range(0, 139));
+			t += -log(1.0 - rnd_unit()) * mean;
+		}
+	}else if (sscanf(arrivals, "burst:%lu:%lu", &size, &gap) == 2 && size > 0) {
+		for (int i = 0; i < nr_procs; i++) {
+			fprintf(file, "%lu %s/prog_%lu %lu\n", (i / size) * gap, dir,
+				(unsigned long)(rnd() % nr_progs), rnd_range(0, 139));
+		}
+	}else{
+		usage();
+		return 1;
+	}
+	fclose(file);
+	free(path);
+	return 0;
+}
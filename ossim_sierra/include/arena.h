@@ -0,0 +1,31 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* Per-process arena.
+ * Holds the PCB and the memory management metadata of one process:
+ * page table, VM areas, regions and page lists. Blocks are carved from
+ * chunks and are only given back all at once by arena_release(), but
+ * small nodes freed with arena_free() are reused by the next
+ * arena_alloc() of the same size. A process runs on one CPU at a time,
+ * so the arena takes no lock. */
+
+struct arena_t;
+
+/* New arena, its bookkeeping lives in its first chunk */
+struct arena_t * arena_create(void);
+
+void * arena_alloc(struct arena_t * arena, size_t size);
+
+void * arena_calloc(struct arena_t * arena, size_t size);
+
+char * arena_strdup(struct arena_t * arena, const char * str);
+
+/* Give back a block of [size] bytes for reuse */
+void arena_free(struct arena_t * arena, void * ptr, size_t size);
+
+/* Free every block of [arena] and the arena itself */
+void arena_release(struct arena_t * arena);
+
+#endif
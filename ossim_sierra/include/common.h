@@ -5,6 +5,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdatomic.h>
 
 #ifndef OSCFG_H
 #include "os-cfg.h"
@@ -44,10 +45,33 @@ struct inst_t
 	uint32_t arg_3;
 };
 
+struct pcb_t;
+
+/* Pre-decoded instruction: the handler that executes it is resolved
+ * once at load time instead of switching on the opcode every run.
+ * Straight-line runs of calc are fused: the first [run] entries from
+ * here can go through a single [exec_run] that executes up to [max] of
+ * them and returns how many it did. A slot is [max], so this only pays
+ * off when a CPU runs more than one instruction per slot (-i). */
+struct dinst_t
+{
+	int (*exec)(struct pcb_t *proc, const struct dinst_t *ins);
+	uint32_t (*exec_run)(struct pcb_t *proc, const struct dinst_t *ins, uint32_t max);
+	uint32_t run;	// Instructions left in the fused run, this one included
+	uint32_t arg_0;
+	uint32_t arg_1;
+	uint32_t arg_2;
+	uint32_t arg_3;
+};
+
 struct code_seg_t
 {
 	struct inst_t *text;
+	struct dinst_t *decoded; // text[] ready to run, same indexes
 	uint32_t size;
+	atomic_int refcount;	 // Processes and cache sharing the segment
+	void *map;		 // Mapped program file behind text, or NULL
+	size_t map_len;
 };
 
 struct trans_table_t
@@ -78,7 +102,7 @@ struct pcb_t
 {
 	uint32_t pid;		 // PID
 	uint32_t priority;	 // Default priority, this legacy process based (FIXED)
-	char path[100];
+	char *path;		 // Program the process runs
 	struct code_seg_t *code; // Code segment
 	addr_t regs[10];	 // Registers, store address of allocated regions
 	uint32_t pc;		 // Program pointer, point to the next instruction
@@ -89,16 +113,24 @@ struct pcb_t
 	// Priority on execution (if supported), on-fly aka. changeable
 	// and this vale overwrites the default priority when it existed
 	uint32_t prio;
+	// Completely fair scheduler bookkeeping
+	uint64_t vruntime;	 // Weighted virtual runtime
+	uint64_t vr_mark;	 // run_slots when the process was last charged
+	struct pcb_t *admit_next; // Link in the scheduler admission queue
 #endif
+	uint64_t run_slots;	 // Time slots the process has spent on a CPU
+	uint64_t admit_time;	 // Time slot the process entered the scheduler
 #ifdef MM_PAGING
 	struct mm_struct *mm;
 	struct memphy_struct *mram;
 	struct memphy_struct **mswp;
 	struct memphy_struct *active_mswp;
 	uint32_t active_mswp_id;
+	uint64_t io_wait;	// Device time owed, thousandths of an instruction
 #endif
 	struct page_table_t *page_table; // Page table
 	uint32_t bp;			 // Break pointer
+	struct arena_t *arena;		 // Holds the PCB and its metadata
 };
 
 #endif
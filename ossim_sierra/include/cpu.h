@@ -9,5 +9,13 @@
  * Otherwise, return 1. */
 int run(struct pcb_t * proc);
 
+/* Execute up to [count] instructions of a process back to back,
+ * stopping early at the end of its code. Return the number of
+ * instructions executed. */
+int run_slice(struct pcb_t * proc, int count);
+
+/* Build the pre-decoded form of a code segment */
+void decode_code(struct code_seg_t * code);
+
 #endif
 
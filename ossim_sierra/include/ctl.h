@@ -0,0 +1,39 @@
+
+#ifndef CTL_H
+#define CTL_H
+
+#include "common.h"
+#include "os-mm.h"
+
+/* Control channel of a running simulation.
+ * A Unix-domain stream socket on which local clients send one command
+ * per line and get a one-line reply:
+ *   submit <program> [priority]	admit a process at the next slot
+ *   slot				current time slot
+ *   queues				ready processes on every CPU
+ *   procs				processes admitted and not finished
+ *   frames				free frames in RAM
+ *   frames free			the free frames, in the order they go out
+ *   shutdown				stop once admitted work is done
+ * Programs are resolved like in configuration files. While the channel
+ * is open the simulation keeps running after the configured workload. */
+
+/* Open the channel at [path]. [mram] is the RAM whose free frames are
+ * reported, NULL without paging. */
+int ctl_open(const char * path, int nr_cpus, struct memphy_struct * mram);
+
+/* Stop serving and remove the socket */
+void ctl_close(void);
+
+int ctl_enabled(void);
+
+/* A client asked the simulation to stop */
+int ctl_shutdown(void);
+
+/* Take the oldest submission, 0 if there is none. [path] is malloc'ed */
+int ctl_take(char ** path, unsigned long * prio);
+
+/* Block until there is a submission or a shutdown request */
+void ctl_wait(void);
+
+#endif
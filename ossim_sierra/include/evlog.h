@@ -0,0 +1,58 @@
+
+#ifndef EVLOG_H
+#define EVLOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Event log of the simulation trace.
+ * Every line of the trace is an event. By default an event is rendered
+ * to stdout as soon as it happens. Once evlog_open() is called, events
+ * are instead stored as compact binary records in a ring owned by the
+ * emitting thread and a writer thread streams the rings to a file;
+ * the evdecode tool renders such a file back to the same text. */
+
+enum evlog_type_t {
+	EV_SLOT,	/* a0: time slot */
+	EV_LD_START,	/* Loader started */
+	EV_LOAD,	/* a0: pid, a1: prio, text: path */
+	EV_DISPATCH,	/* a0: cpu, a1: pid */
+	EV_PUT,		/* a0: cpu, a1: pid */
+	EV_FINISH,	/* a0: cpu, a1: pid */
+	EV_CPU_STOP,	/* a0: cpu */
+	EV_READ,	/* a0: region, a1: offset, a2: value */
+	EV_WRITE,	/* a0: region, a1: offset, a2: value */
+	EV_PGTBL,	/* Start of a page table dump */
+	EV_PTE,		/* a0: page number, a1: page table entry */
+	EV_MEMPHY,	/* Start of a physical memory dump */
+	EV_MEMPHY_BYTE,	/* a0: address, a1: value */
+	EV_NR_TYPES,
+};
+
+/* On-disk record. Events with text are followed by as many records as
+ * it takes to hold [len] bytes of text. */
+struct evlog_rec_t {
+	uint64_t seq;	/* Global emission order */
+	uint32_t type;
+	uint32_t len;	/* Bytes of text that follow */
+	uint64_t a[3];
+};
+
+#define EVLOG_MAGIC	"OSEVLOG1"
+
+/* Records in the ring of every emitting thread, a power of two */
+#define EVLOG_RING_SIZE	(1 << 14)
+
+/* Log events in binary form to [path] from now on */
+int evlog_open(const char * path);
+
+/* Flush every ring and stop the writer */
+void evlog_close(void);
+
+void evlog(enum evlog_type_t type, uint64_t a0, uint64_t a1, uint64_t a2,
+		const char * text);
+
+/* Print the text form of an event */
+void evlog_render(FILE * out, const struct evlog_rec_t * rec, const char * text);
+
+#endif
@@ -18,7 +18,7 @@
 
 extern struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid);
 int inc_vma_limit(struct pcb_t*, int, int);
-int __mm_swap_page(struct pcb_t*, int, int);
+long __mm_swap_page(struct pcb_t*, int, int);
 int liballoc(struct pcb_t *, uint32_t, uint32_t);
 int libfree(struct pcb_t *, uint32_t);
 int libread(struct pcb_t*, uint32_t, uint32_t, uint32_t*);
@@ -3,7 +3,44 @@
 
 #include "common.h"
 
+/* Compiled program file: this header followed by [size] instructions
+ * stored as struct inst_t, in host byte order, so that load() can map
+ * them as the code segment without copying. Build one with tools/progc. */
+#define PROG_MAGIC	"OSPROG01"
+
+struct prog_hdr_t {
+	char magic[8];
+	uint32_t priority;
+	uint32_t size;
+};
+
 struct pcb_t * load(const char * path);
 
+/* Build the PCB of the program at [path] without giving it a PID, so
+ * that programs can be read by several threads in any order */
+struct pcb_t * load_proc(const char * path);
+
+/* Whether [path] holds a program that load() can run, 0 if it does.
+ * Unlike load(), a bad file is reported and does not end the run */
+int check_program(const char * path);
+
+/* Give back everything a finished or killed process holds: its frames
+ * and swap slots go to the free pools of the devices, the rest is in
+ * its arena. [proc] is gone afterwards */
+void free_proc(struct pcb_t * proc);
+
+/* Give [proc] the next PID */
+void attach_pid(struct pcb_t * proc);
+
+/* Resolve the first [len] bytes of [name] as given when they have a
+ * directory part, in [dir] otherwise. The result is malloc'ed. */
+char * resolve_path(const char * dir, const char * name, size_t len);
+
+/* Drop a reference on a code segment handed out by load() */
+void release_code(struct code_seg_t * code);
+
+/* Drop the references the code cache holds */
+void flush_code_cache(void);
+
 #endif
 
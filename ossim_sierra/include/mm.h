@@ -2,6 +2,7 @@
 
 #include "bitops.h"
 #include "common.h"
+#include "arena.h"
 
 /* CPU Bus definition */
 #define PAGING_CPU_BUS_WIDTH 22 /* 22bit bus - MAX SPACE 4MB */
@@ -99,15 +100,15 @@
 #define OVERLAP(x1,x2,y1,y2) (0)
 
 /* VM region prototypes */
-struct vm_rg_struct * init_vm_rg(int rg_start, int rg_endi);
+struct vm_rg_struct * init_vm_rg(struct arena_t *arena, int rg_start, int rg_endi);
 int enlist_vm_rg_node(struct vm_rg_struct **rglist, struct vm_rg_struct* rgnode);
-int enlist_pgn_node(struct pgn_t **pgnlist, int pgn);
+int enlist_pgn_node(struct arena_t *arena, struct pgn_t **pgnlist, int pgn);
 int vmap_page_range(struct pcb_t *caller, int addr, int pgnum, 
                     struct framephy_struct *frames, struct vm_rg_struct *ret_rg);
 int vm_map_ram(struct pcb_t *caller, int astart, int send, int mapstart, int incpgnum, struct vm_rg_struct *ret_rg);
 int alloc_pages_range(struct pcb_t *caller, int incpgnum, struct framephy_struct **frm_lst);
-int __swap_cp_page(struct memphy_struct *mpsrc, int srcfpn,
-                struct memphy_struct *mpdst, int dstfpn) ;
+long __swap_cp_page(struct memphy_struct *mpsrc, int srcfpn,
+                 struct memphy_struct *mpdst, int dstfpn) ;
 int pte_set_fpn(uint32_t *pte, int fpn);
 int pte_set_swap(uint32_t *pte, int swptyp, int swpoff);
 int init_pte(uint32_t *pte,
@@ -122,6 +123,7 @@ int __free(struct pcb_t *caller, int vmaid, int rgid);
 int __read(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE *data);
 int __write(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE value);
 int init_mm(struct mm_struct *mm, struct pcb_t *caller);
+int free_pcb_memph(struct pcb_t *caller);
 
 /* VM prototypes */
 int pgalloc(struct pcb_t *proc, uint32_t size, uint32_t reg_index);
@@ -142,15 +144,32 @@ int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, int vmastart, int
 int get_free_vmrg_area(struct pcb_t *caller, int vmaid, int size, struct vm_rg_struct *newrg);
 int inc_vma_limit(struct pcb_t *caller, int vmaid, int inc_sz);
 int find_victim_page(struct mm_struct* mm, int *pgn);
+
+/* Page faults taken so far by every process */
+unsigned long mm_page_faults(void);
 struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid);
 
 /* MEM/PHY protypes */
 int MEMPHY_get_freefp(struct memphy_struct *mp, int *fpn);
 int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn);
+int MEMPHY_put_freefps(struct memphy_struct *mp, const int *fpns, int n);
+int MEMPHY_set_owner(struct memphy_struct *mp, int fpn, struct mm_struct *owner);
+struct mm_struct *MEMPHY_get_owner(struct memphy_struct *mp, int fpn);
+struct framephy_struct *MEMPHY_free_list(struct memphy_struct *mp);
 int MEMPHY_read(struct memphy_struct * mp, int addr, BYTE *value);
 int MEMPHY_write(struct memphy_struct * mp, int addr, BYTE data);
+long MEMPHY_read_page(struct memphy_struct *mp, int fpn, BYTE *buf);
+long MEMPHY_write_page(struct memphy_struct *mp, int fpn, const BYTE *buf);
+long MEMPHY_copy_page(struct memphy_struct *mpsrc, int srcfpn,
+                      struct memphy_struct *mpdst, int dstfpn);
+void MEMPHY_set_cost(struct memphy_struct *mp, unsigned int seek_cost,
+                     unsigned int xfer_cost);
 int MEMPHY_dump(struct memphy_struct * mp);
 int init_memphy(struct memphy_struct *mp, int max_size, int randomflg);
+int init_memphy_file(struct memphy_struct *mp, int max_size, int randomflg,
+                     const char *path, int direct);
+int MEMPHY_sync(struct memphy_struct *mp);
+void MEMPHY_release(struct memphy_struct *mp);
 
 /* print list */
 int print_list_fp(struct framephy_struct *fp);
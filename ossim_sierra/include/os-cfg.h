@@ -4,8 +4,30 @@
 #define MLQ_SCHED 1
 #define MAX_PRIO 140
 
+/* Fast-forward time slots in which every CPU and the loader are idle */
+#define IDLE_SKIP 1
+
+/* Report run queue lock contention, work stealing and CPU shares on
+ * exit. Off unless built with `make STATS=1` */
+// #define SCHED_STATS 1
+
+/* Report host time spent reading programs apart from simulating. Off
+ * unless built with `make STATS=1` */
+// #define LOAD_STATS 1
+
 #define MM_PAGING
 #define MM_FIXED_MEMSZ
+
+/* Swap devices are sequential: every access moves the cursor to the
+ * frame, then transfers it. Per byte costs, in thousandths of an
+ * instruction time, are charged to the process waiting on the swap */
+#define MEMSWP_SEQ 0
+#define MEMSWP_SEEK_COST 1
+#define MEMSWP_XFER_COST 10
+
+/* Frames a swap file holds back to write out as one contiguous run */
+#define MEMSWP_WB_PAGES 64
+
 #define VMDBG 1
 #define MMDBG 1
 #define IODUMP 1
@@ -56,6 +56,9 @@ struct mm_struct {
 
    /* list of free page */
    struct pgn_t *fifo_pgn;
+
+   /* Arena of the owner, the nodes above come from it */
+   struct arena_t *arena;
 };
 
 /*
@@ -77,10 +80,39 @@ struct memphy_struct {
    /* Sequential device fields */ 
    int rdmflg;
    int cursor;
-
-   /* Management structure */
-   struct framephy_struct *free_fp_list;
-   struct framephy_struct *used_fp_list;
+   unsigned long seek_bytes;   /* Cursor travel so far */
+   unsigned long xfer_bytes;   /* Bytes read or written at the cursor */
+   unsigned int seek_cost;     /* Per byte, thousandths of an instruction */
+   unsigned int xfer_cost;
+
+   /* Host file backing, storage is NULL (init_memphy_file) */
+   int fd;                      /* -1 for a device in memory */
+   int direct;                  /* Opened O_DIRECT, I/O in aligned blocks */
+   BYTE *wb_buf;                /* Writes held back to go out as a run */
+   BYTE *bounce_buf;            /* Aligned blocks for O_DIRECT */
+   int wb_addr;
+   int wb_len;
+   unsigned long io_ops;        /* pread and pwrite calls */
+   atomic_flag io_lock;
+
+   /* Management structure. Free frames are the ones given back, last
+    * in first out, on [free_fp_stack], then [fp_fresh] up to [maxfp]
+    * which were never handed out: the order of the old free list,
+    * without a node per frame. MEMPHY_free_list() rebuilds the list */
+   int maxfp;
+   int *free_fp_stack;
+   int nr_stacked_fp;
+   int fp_fresh;
+   int nr_free_fp;
+   BYTE *fp_state;              /* FP_FREE, FP_USED or FP_TRIM, per frame */
+   struct mm_struct **fp_owner; /* Holder of each used frame, if known */
+   int trim_span;               /* Frames per host page, 0: never trimmed */
+   int trim_pending;            /* Free host page not trimmed yet, or -1 */
+   atomic_flag fp_lock; /* Guards the pool, CPUs share the device */
 };
 
+#define FP_FREE 0
+#define FP_USED 1
+#define FP_TRIM 2    /* Free, its host page is being handed back */
+
 #endif
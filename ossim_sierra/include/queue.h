@@ -4,18 +4,38 @@
 
 #include "common.h"
 
-#define MAX_QUEUE_SIZE 10
+/* Capacity a queue gets on its first enqueue if nobody gave it storage */
+#define QUEUE_INIT_CAP 8
 
+/* FIFO ring buffer of processes. A zeroed queue is a valid empty queue;
+ * the storage doubles when full. */
 struct queue_t {
-	struct pcb_t * proc[MAX_QUEUE_SIZE];
+	struct pcb_t ** proc;
+	int head;	/* Index of the oldest process in [proc] */
 	int size;
+	int capacity;
+	int owned;	/* [proc] was allocated by the queue and must be freed */
 };
 
+/* Start [q] empty on [capacity] slots of caller-owned [storage], e.g. a
+ * slice of a pool shared by many queues. The queue moves to its own
+ * storage if it ever outgrows it. */
+void queue_init(struct queue_t * q, struct pcb_t ** storage, int capacity);
+
+/* Release the storage [q] allocated for itself */
+void queue_free(struct queue_t * q);
+
 void enqueue(struct queue_t * q, struct pcb_t * proc);
 
 struct pcb_t * dequeue(struct queue_t * q);
 
 int empty(struct queue_t * q);
 
+/* The [i]-th process from the head of [q] */
+struct pcb_t * queue_at(struct queue_t * q, int i);
+
+/* Remove [proc] from [q], return 0 if it was not there */
+int queue_remove(struct queue_t * q, struct pcb_t * proc);
+
 #endif
 
@@ -1,5 +1,5 @@
-#ifndef QUEUE_H
-#define QUEUE_H
+#ifndef SCHED_H
+#define SCHED_H
 
 #include "common.h"
 
@@ -11,18 +11,48 @@
 
 int queue_empty(void);
 
-void init_scheduler(void);
+/* Scheduling policies */
+enum sched_policy_t {
+	SCHED_MLQ,	/* Multi-level queue with per-level slot quota */
+	SCHED_CFS,	/* Completely fair, by weighted virtual runtime */
+};
+
+/* Policy named [name] ("mlq" or "cfs"), -1 if there is none */
+int sched_policy_from_name(const char * name);
+
+/* Set up one run queue per CPU running [policy] */
+void init_scheduler(int nr_cpus, enum sched_policy_t policy);
 void finish_scheduler(void);
 
-/* Get the next process from ready queue */
-struct pcb_t * get_proc(void);
+/* Get the next process for [cpu], stealing from the busiest peer when
+ * the run queue of [cpu] is empty */
+struct pcb_t * get_proc(int cpu);
 
-/* Put a process back to run queue */
-void put_proc(struct pcb_t * proc);
+/* Put a process back to the run queue of [cpu] */
+void put_proc(int cpu, struct pcb_t * proc);
 
 /* Add a new process to ready queue */
 void add_proc(struct pcb_t * proc);
 
+/* Drop a finished process from the running list of [cpu] */
+void finish_proc(int cpu, struct pcb_t * proc);
+
+/* Keep the CPU share of finished processes for the report on exit,
+ * on by default. Benchmarks that finish processes by the thousand
+ * turn it off */
+void sched_record_shares(int on);
+
+/* Remove every ready process loaded from [path], return how many.
+ * [reap], if not NULL, is called on each of them once the run queues
+ * are unlocked */
+int kill_procs(const char * path, void (*reap)(struct pcb_t * proc));
+
+/* Processes added and not finished or killed yet */
+int live_procs(void);
+
+/* Processes waiting in the run queue of [cpu] */
+int ready_procs(int cpu);
+
 #endif
 
 
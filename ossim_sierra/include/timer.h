@@ -4,13 +4,17 @@
 #include <pthread.h>
 #include <stdint.h>
 
+/* Number of polls a device spends spinning on the slot barrier before
+ * it sleeps. Spinning is only used while every device can own a host
+ * core, otherwise waiters go to sleep at once. */
+#define TIMER_SPIN_LIMIT	2000
+
+/* Wakeup time of a device that waits for work made by other devices */
+#define TIMER_NO_WAKEUP		UINT64_MAX
+
 struct timer_id_t {
-	int done;
-	int fsh;
-	pthread_cond_t event_cond;
-	pthread_mutex_t event_lock;
-	pthread_cond_t timer_cond;
-	pthread_mutex_t timer_lock;
+	int fsh;	/* Device has detached from the slot barrier */
+	int sense;	/* Local sense, flipped every time the device ends a slot */
 };
 
 void start_timer();
@@ -23,6 +27,18 @@ void detach_event(struct timer_id_t * event);
 
 void next_slot(struct timer_id_t* timer_id);
 
+/* Same as next_slot() but tells the timer that the device has nothing
+ * to do before time [wakeup]. When every attached device ends a slot
+ * idle, the timer jumps straight to the earliest wakeup. */
+void next_slot_idle(struct timer_id_t* timer_id, uint64_t wakeup);
+
 uint64_t current_time();
 
+/* Drive the clock by hand from a single-threaded event loop instead of
+ * the slot barrier: step_timer() advances to time [next], printing
+ * every slot on the way. */
+void start_manual_timer();
+
+void step_timer(uint64_t next);
+
 #endif
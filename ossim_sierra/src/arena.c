@@ -0,0 +1,104 @@
+
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_CHUNK	4096	/* Bytes per chunk */
+#define ARENA_BIG	(ARENA_CHUNK / 4)	/* Larger blocks get a chunk each */
+#define ARENA_ALIGN	16
+#define ARENA_CLASSES	8	/* Sizes reused by arena_free(): 16 to 128 bytes */
+
+#define ALIGN_UP(n)	(((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct arena_chunk_t {
+	struct arena_chunk_t * next;
+};
+
+#define CHUNK_HDR	ALIGN_UP(sizeof(struct arena_chunk_t))
+
+struct arena_t {
+	struct arena_chunk_t * chunks;	/* Newest first, the one holding us last */
+	char * cur;			/* Free space left in the newest chunk */
+	size_t left;
+	void * free_nodes[ARENA_CLASSES];
+};
+
+struct arena_t * arena_create(void) {
+	struct arena_chunk_t * chunk = (struct arena_chunk_t *)malloc(ARENA_CHUNK);
+	if (chunk == NULL) return NULL;
+	chunk->next = NULL;
+
+	struct arena_t * arena = (struct arena_t *)((char *)chunk + CHUNK_HDR);
+	memset(arena, 0, sizeof(struct arena_t));
+	arena->chunks = chunk;
+	arena->cur = (char *)chunk + CHUNK_HDR + ALIGN_UP(sizeof(struct arena_t));
+	arena->left = ARENA_CHUNK - CHUNK_HDR - ALIGN_UP(sizeof(struct arena_t));
+	return arena;
+}
+
+/* Link a chunk with room for [size] bytes behind its header */
+static void * arena_chunk(struct arena_t * arena, size_t size) {
+	struct arena_chunk_t * chunk = (struct arena_chunk_t *)malloc(CHUNK_HDR + size);
+	if (chunk == NULL) return NULL;
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+	return (char *)chunk + CHUNK_HDR;
+}
+
+void * arena_alloc(struct arena_t * arena, size_t size) {
+	size = (size == 0) ? ARENA_ALIGN : ALIGN_UP(size);
+
+	size_t cls = size / ARENA_ALIGN - 1;
+	if (cls < ARENA_CLASSES && arena->free_nodes[cls] != NULL) {
+		void * node = arena->free_nodes[cls];
+		arena->free_nodes[cls] = *(void **)node;
+		return node;
+	}
+
+	if (size > ARENA_BIG) {
+		return arena_chunk(arena, size);
+	}
+	if (size > arena->left) {
+		char * space = (char *)arena_chunk(arena, ARENA_CHUNK - CHUNK_HDR);
+		if (space == NULL) return NULL;
+		arena->cur = space;
+		arena->left = ARENA_CHUNK - CHUNK_HDR;
+	}
+	void * ptr = arena->cur;
+	arena->cur += size;
+	arena->left -= size;
+	return ptr;
+}
+
+void * arena_calloc(struct arena_t * arena, size_t size) {
+	void * ptr = arena_alloc(arena, size);
+	if (ptr != NULL) memset(ptr, 0, size);
+	return ptr;
+}
+
+char * arena_strdup(struct arena_t * arena, const char * str) {
+	size_t len = strlen(str) + 1;
+	char * copy = (char *)arena_alloc(arena, len);
+	if (copy != NULL) memcpy(copy, str, len);
+	return copy;
+}
+
+void arena_free(struct arena_t * arena, void * ptr, size_t size) {
+	if (ptr == NULL) return;
+	size = (size == 0) ? ARENA_ALIGN : ALIGN_UP(size);
+	size_t cls = size / ARENA_ALIGN - 1;
+	if (cls < ARENA_CLASSES) {
+		*(void **)ptr = arena->free_nodes[cls];
+		arena->free_nodes[cls] = ptr;
+	}
+}
+
+void arena_release(struct arena_t * arena) {
+	if (arena == NULL) return;
+	struct arena_chunk_t * chunk = arena->chunks;
+	while (chunk != NULL) {
+		struct arena_chunk_t * next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+}
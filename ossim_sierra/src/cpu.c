@@ -4,6 +4,7 @@
 #include "mm.h"
 #include "syscall.h"
 #include "libmem.h"
+#include <stdlib.h>
 
 int calc(struct pcb_t *proc)
 {
@@ -58,55 +59,153 @@ int write(
 	return write_mem(proc->regs[destination] + offset, proc, data);
 }
 
-int run(struct pcb_t *proc)
+static int exec_calc(struct pcb_t *proc, const struct dinst_t *ins)
 {
-	/* Check if Program Counter point to the proper instruction */
-	if (proc->pc >= proc->code->size)
-	{
-		return 1;
-	}
+	return calc(proc);
+}
 
-	struct inst_t ins = proc->code->text[proc->pc];
-	proc->pc++;
-	int stat = 1;
-switch (ins.opcode)
-	{
-	case CALC:
-		stat = calc(proc);
-		break;
-	case ALLOC:
+static int exec_alloc(struct pcb_t *proc, const struct dinst_t *ins)
+{
 #ifdef MM_PAGING
-		stat = liballoc(proc, ins.arg_0, ins.arg_1);
+	return liballoc(proc, ins->arg_0, ins->arg_1);
 #else
-		stat = alloc(proc, ins.arg_0, ins.arg_1);
+	return alloc(proc, ins->arg_0, ins->arg_1);
 #endif
-		break;
-	case FREE:
+}
+
+static int exec_free(struct pcb_t *proc, const struct dinst_t *ins)
+{
 #ifdef MM_PAGING
-		stat = libfree(proc, ins.arg_0);
+	return libfree(proc, ins->arg_0);
 #else
-		stat = free_data(proc, ins.arg_0);
+	return free_data(proc, ins->arg_0);
 #endif
-		break;
-	case READ:
+}
+
+static int exec_read(struct pcb_t *proc, const struct dinst_t *ins)
+{
 #ifdef MM_PAGING
-		stat = libread(proc, ins.arg_0, ins.arg_1, &ins.arg_2);
+	/* The program text is shared, the result only goes to a scratch */
+	uint32_t destination = ins->arg_2;
+	return libread(proc, ins->arg_0, ins->arg_1, &destination);
 #else
-		stat = read(proc, ins.arg_0, ins.arg_1, ins.arg_2);
+	return read(proc, ins->arg_0, ins->arg_1, ins->arg_2);
 #endif
-		break;
-	case WRITE:
+}
+
+static int exec_write(struct pcb_t *proc, const struct dinst_t *ins)
+{
 #ifdef MM_PAGING
-		stat = libwrite(proc, ins.arg_0, ins.arg_1, ins.arg_2);
+	return libwrite(proc, ins->arg_0, ins->arg_1, ins->arg_2);
 #else
-		stat = write(proc, ins.arg_0, ins.arg_1, ins.arg_2);
+	return write(proc, ins->arg_0, ins->arg_1, ins->arg_2);
 #endif
-		break;
-	case SYSCALL:
-		stat = libsyscall(proc, ins.arg_0, ins.arg_1, ins.arg_2, ins.arg_3);
-		break;
-	default:
-		stat = 1;
+}
+
+static int exec_syscall(struct pcb_t *proc, const struct dinst_t *ins)
+{
+	return libsyscall(proc, ins->arg_0, ins->arg_1, ins->arg_2, ins->arg_3);
+}
+
+static int exec_invalid(struct pcb_t *proc, const struct dinst_t *ins)
+{
+	return 1;
+}
+
+/* A calc does nothing but burn its slot, a run of them is a jump */
+static uint32_t exec_calc_run(struct pcb_t *proc, const struct dinst_t *ins, uint32_t max)
+{
+	uint32_t n = (ins->run < max) ? ins->run : max;
+	proc->pc += n;
+	return n;
+}
+
+static uint32_t exec_one(struct pcb_t *proc, const struct dinst_t *ins, uint32_t max)
+{
+	proc->pc++;
+	ins->exec(proc, ins);
+	return 1;
+}
+
+void decode_code(struct code_seg_t *code)
+{
+	code->decoded = (struct dinst_t *)malloc(
+		sizeof(struct dinst_t) * (code->size ? code->size : 1));
+	for (uint32_t i = 0; i < code->size; i++)
+	{
+		struct inst_t *ins = &code->text[i];
+		struct dinst_t *d = &code->decoded[i];
+		switch (ins->opcode)
+		{
+		case CALC:
+			d->exec = exec_calc;
+			break;
+		case ALLOC:
+			d->exec = exec_alloc;
+			break;
+		case FREE:
+			d->exec = exec_free;
+			break;
+		case READ:
+			d->exec = exec_read;
+			break;
+		case WRITE:
+			d->exec = exec_write;
+			break;
+		case SYSCALL:
+			d->exec = exec_syscall;
+			break;
+		default:
+			d->exec = exec_invalid;
+		}
+		d->arg_0 = ins->arg_0;
+		d->arg_1 = ins->arg_1;
+		d->arg_2 = ins->arg_2;
+		d->arg_3 = ins->arg_3;
+	}
+
+	/* Fusion pass, backwards so every entry knows the rest of its calc
+	 * run. Memory operations and syscalls go one at a time */
+	for (uint32_t i = code->size; i-- > 0;)
+	{
+		struct dinst_t *d = &code->decoded[i];
+		d->run = 1;
+		if (code->text[i].opcode != CALC)
+		{
+			d->exec_run = exec_one;
+			continue;
+		}
+		if (i + 1 < code->size && code->text[i + 1].opcode == CALC)
+		{
+			d->run = code->decoded[i + 1].run + 1;
+		}
+		d->exec_run = exec_calc_run;
+	}
+}
+
+int run(struct pcb_t *proc)
+{
+	/* Check if Program Counter point to the proper instruction */
+	if (proc->pc >= proc->code->size)
+	{
+		return 1;
+	}
+
+	const struct dinst_t *ins = &proc->code->decoded[proc->pc];
+	proc->pc++;
+	return ins->exec(proc, ins);
+}
+
+int run_slice(struct pcb_t *proc, int count)
+{
+	const struct dinst_t *text = proc->code->decoded;
+	uint32_t size = proc->code->size;
+	int done = 0;
+
+	while (done < count && proc->pc < size)
+	{
+		const struct dinst_t *ins = &text[proc->pc];
+		done += ins->exec_run(proc, ins, count - done);
 	}
-	return stat;
+	return done;
 }
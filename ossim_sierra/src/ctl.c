@@ -0,0 +1,308 @@
+#include "ctl.h"
+#include "loader.h"
+#include "mm.h"
+#include "sched.h"
+#include "timer.h"
+#include <pthread.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define CTL_MAX_CLIENTS	64
+#define CTL_LINE_MAX	4096
+
+struct ctl_client_t {
+	int fd;
+	size_t len;	/* Bytes of the pending line in [buf] */
+	char buf[CTL_LINE_MAX];
+};
+
+struct ctl_submit_t {
+	char * path;
+	unsigned long prio;
+	struct ctl_submit_t * next;
+};
+
+static atomic_int enabled = 0;
+static atomic_int stopping = 0;
+static atomic_int shutdown_asked = 0;
+
+static int listen_fd = -1;
+/* Wakes the server up from poll() on close. Sockets are only used
+ * through recv/send: the simulated CPU defines its own read and write. */
+static int wake_pipe[2];
+static char * sock_path = NULL;
+static pthread_t server;
+
+static int ctl_nr_cpus;
+static struct memphy_struct * ctl_mram;
+
+/* Submissions in arrival order */
+static pthread_mutex_t submit_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t submit_cond = PTHREAD_COND_INITIALIZER;
+static struct ctl_submit_t * submit_head = NULL;
+static struct ctl_submit_t ** submit_tail = &submit_head;
+
+static void reply(int fd, const char * fmt, ...) {
+	char buf[CTL_LINE_MAX];
+	va_list ap;
+	va_start(ap, fmt);
+	int n = vsnprintf(buf, sizeof(buf) - 1, fmt, ap);
+	va_end(ap);
+	if (n < 0) return;
+	if (n > (int)sizeof(buf) - 2) n = sizeof(buf) - 2;
+	buf[n++] = '\n';
+	for (int off = 0; off < n; ) {
+		ssize_t w = send(fd, buf + off, n - off, MSG_NOSIGNAL);
+		if (w <= 0) return;
+		off += w;
+	}
+}
+
+static void submit(int fd, char * args) {
+	char * name = strtok(args, " \t");
+	char * prio = strtok(NULL, " \t");
+	if (name == NULL) {
+		reply(fd, "error usage: submit <program> [priority]");
+		return;
+	}
+	/* The priority indexes the run queue levels */
+	unsigned long level = 0;
+	if (prio != NULL) {
+		char * end;
+		level = strtoul(prio, &end, 10);
+		if (end == prio || *end != '\0' || prio[0] == '-' || level >= MAX_PRIO) {
+			reply(fd, "error priority %s is not in 0..%d", prio, MAX_PRIO - 1);
+			return;
+		}
+	}
+	char * path = resolve_path("input/proc/", name, strlen(name));
+	if (access(path, R_OK) != 0) {
+		reply(fd, "error cannot read %s", path);
+		free(path);
+		return;
+	}
+	/* A bad program would end the run once the loader gets to it */
+	if (check_program(path) != 0) {
+		reply(fd, "error not a program %s", path);
+		free(path);
+		return;
+	}
+	struct ctl_submit_t * sub = (struct ctl_submit_t*)malloc(sizeof(struct ctl_submit_t));
+	sub->path = path;
+	sub->prio = level;
+	sub->next = NULL;
+	pthread_mutex_lock(&submit_lock);
+	*submit_tail = sub;
+	submit_tail = &sub->next;
+	pthread_cond_broadcast(&submit_cond);
+	pthread_mutex_unlock(&submit_lock);
+	reply(fd, "ok");
+}
+
+/* The free frames of RAM in the order they will be handed out, as many
+ * as fit on the line */
+static void free_frames(int fd) {
+	char buf[CTL_LINE_MAX];
+	int n = snprintf(buf, sizeof(buf), "free");
+	struct framephy_struct * fp = MEMPHY_free_list(ctl_mram);
+	while (fp != NULL) {
+		struct framephy_struct * next = fp->fp_next;
+		if (n < (int)sizeof(buf) - 12) {
+			n += snprintf(buf + n, sizeof(buf) - n, " %d", fp->fpn);
+		}
+		free(fp);
+		fp = next;
+	}
+	reply(fd, "%s", buf);
+}
+
+static void command(int fd, char * line) {
+	char * cmd = strtok(line, " \t");
+	char * args = strtok(NULL, "");
+	char none[1] = "";
+	if (cmd == NULL) return;
+
+	if (!strcmp(cmd, "submit")) {
+		submit(fd, (args == NULL) ? none : args);
+	}else if (!strcmp(cmd, "slot")) {
+		reply(fd, "slot %lu", (unsigned long)current_time());
+	}else if (!strcmp(cmd, "queues")) {
+		char buf[CTL_LINE_MAX];
+		int n = snprintf(buf, sizeof(buf), "queues");
+		for (int i = 0; i < ctl_nr_cpus && n < (int)sizeof(buf); i++) {
+			n += snprintf(buf + n, sizeof(buf) - n, " %d", ready_procs(i));
+		}
+		reply(fd, "%s", buf);
+	}else if (!strcmp(cmd, "procs")) {
+		reply(fd, "procs %d", live_procs());
+	}else if (!strcmp(cmd, "frames")) {
+		if (ctl_mram == NULL) {
+			reply(fd, "error no paging");
+		}else if (args != NULL && !strcmp(args, "free")) {
+			free_frames(fd);
+		}else if (args != NULL) {
+			reply(fd, "error usage: frames [free]");
+		}else{
+			reply(fd, "frames %d", ctl_mram->nr_free_fp);
+		}
+	}else if (!strcmp(cmd, "shutdown")) {
+		pthread_mutex_lock(&submit_lock);
+		atomic_store(&shutdown_asked, 1);
+		pthread_cond_broadcast(&submit_cond);
+		pthread_mutex_unlock(&submit_lock);
+		reply(fd, "ok");
+	}else{
+		reply(fd, "error unknown command %s", cmd);
+	}
+}
+
+/* Run every complete line [c] has received, 0 once it hung up */
+static int serve_client(struct ctl_client_t * c) {
+	ssize_t n = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, 0);
+	if (n <= 0) return 0;
+	c->len += n;
+
+	char * start = c->buf;
+	char * nl;
+	while ((nl = memchr(start, '\n', c->buf + c->len - start)) != NULL) {
+		*nl = '\0';
+		if (nl > start && nl[-1] == '\r') nl[-1] = '\0';
+		command(c->fd, start);
+		start = nl + 1;
+	}
+	c->len -= start - c->buf;
+	memmove(c->buf, start, c->len);
+	if (c->len == sizeof(c->buf)) {
+		reply(c->fd, "error line too long");
+		return 0;
+	}
+	return 1;
+}
+
+static void * server_routine(void * args) {
+	struct pollfd fds[CTL_MAX_CLIENTS + 2];
+	struct ctl_client_t * clients[CTL_MAX_CLIENTS];
+	int nr_clients = 0;
+
+	while (!atomic_load(&stopping)) {
+		fds[0].fd = wake_pipe[0];
+		fds[0].events = POLLIN;
+		fds[1].fd = listen_fd;
+		fds[1].events = (nr_clients < CTL_MAX_CLIENTS) ? POLLIN : 0;
+		for (int i = 0; i < nr_clients; i++) {
+			fds[i + 2].fd = clients[i]->fd;
+			fds[i + 2].events = POLLIN;
+		}
+		if (poll(fds, nr_clients + 2, -1) < 0) continue;
+
+		for (int i = nr_clients - 1; i >= 0; i--) {
+			if (fds[i + 2].revents == 0) continue;
+			if (!serve_client(clients[i])) {
+				close(clients[i]->fd);
+				free(clients[i]);
+				clients[i] = clients[--nr_clients];
+			}
+		}
+		if (fds[1].revents & POLLIN) {
+			int fd = accept(listen_fd, NULL, NULL);
+			if (fd >= 0) {
+				clients[nr_clients] = (struct ctl_client_t*)malloc(sizeof(struct ctl_client_t));
+				clients[nr_clients]->fd = fd;
+				clients[nr_clients]->len = 0;
+				nr_clients++;
+			}
+		}
+	}
+	while (nr_clients > 0) {
+		nr_clients--;
+		close(clients[nr_clients]->fd);
+		free(clients[nr_clients]);
+	}
+	return args;
+}
+
+int ctl_open(const char * path, int nr_cpus, struct memphy_struct * mram) {
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	if ((listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		return -1;
+	}
+	unlink(path);
+	if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+	    listen(listen_fd, 16) != 0 ||
+	    socketpair(AF_UNIX, SOCK_STREAM, 0, wake_pipe) != 0) {
+		close(listen_fd);
+		return -1;
+	}
+	sock_path = strdup(path);
+	ctl_nr_cpus = nr_cpus;
+	ctl_mram = mram;
+	atomic_store(&enabled, 1);
+	pthread_create(&server, NULL, server_routine, NULL);
+	return 0;
+}
+
+void ctl_close(void) {
+	if (!atomic_load(&enabled)) return;
+	atomic_store(&stopping, 1);
+	if (send(wake_pipe[1], "", 1, 0) < 0) {
+		perror("ctl");
+	}
+	pthread_join(server, NULL);
+	close(wake_pipe[0]);
+	close(wake_pipe[1]);
+	close(listen_fd);
+	unlink(sock_path);
+	free(sock_path);
+	atomic_store(&enabled, 0);
+
+	char * path;
+	unsigned long prio;
+	while (ctl_take(&path, &prio)) {
+		free(path);
+	}
+}
+
+int ctl_enabled(void) {
+	return atomic_load(&enabled);
+}
+
+int ctl_shutdown(void) {
+	return atomic_load(&shutdown_asked);
+}
+
+int ctl_take(char ** path, unsigned long * prio) {
+	pthread_mutex_lock(&submit_lock);
+	struct ctl_submit_t * sub = submit_head;
+	if (sub != NULL) {
+		submit_head = sub->next;
+		if (submit_head == NULL) submit_tail = &submit_head;
+	}
+	pthread_mutex_unlock(&submit_lock);
+	if (sub == NULL) return 0;
+	*path = sub->path;
+	*prio = sub->prio;
+	free(sub);
+	return 1;
+}
+
+void ctl_wait(void) {
+	pthread_mutex_lock(&submit_lock);
+	while (submit_head == NULL && !atomic_load(&shutdown_asked)) {
+		pthread_cond_wait(&submit_cond, &submit_lock);
+	}
+	pthread_mutex_unlock(&submit_lock);
+}
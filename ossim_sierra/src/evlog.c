@@ -0,0 +1,199 @@
+#include "evlog.h"
+#include "mm.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Single-producer ring of one emitting thread. The owner only moves
+ * [tail], the writer only moves [head]. */
+struct evlog_ring_t {
+	struct evlog_rec_t rec[EVLOG_RING_SIZE];
+	atomic_ulong head;
+	atomic_ulong tail;
+	struct evlog_ring_t * next;
+};
+
+static atomic_int enabled = 0;
+static atomic_ulong next_seq = 0;
+static atomic_int stopping = 0;
+
+static FILE * log_file = NULL;
+static pthread_t writer;
+
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct evlog_ring_t * rings = NULL;
+static __thread struct evlog_ring_t * my_ring = NULL;
+
+#define REC_TEXT(len) (((len) + sizeof(struct evlog_rec_t) - 1) / sizeof(struct evlog_rec_t))
+
+void evlog_render(FILE * out, const struct evlog_rec_t * rec, const char * text) {
+	const uint64_t * a = rec->a;
+	switch (rec->type) {
+	case EV_SLOT:
+		fprintf(out, "Time slot %3lu\n", a[0]);
+		break;
+	case EV_LD_START:
+		fprintf(out, "ld_routine\n");
+		break;
+	case EV_LOAD:
+		fprintf(out, "\tLoaded a process at %.*s, PID: %d PRIO: %ld\n",
+			(int)rec->len, text, (int)a[0], (long)a[1]);
+		break;
+	case EV_DISPATCH:
+		fprintf(out, "\tCPU %d: Dispatched process %2d\n", (int)a[0], (int)a[1]);
+		break;
+	case EV_PUT:
+		fprintf(out, "\tCPU %d: Put process %2d to run queue\n", (int)a[0], (int)a[1]);
+		break;
+	case EV_FINISH:
+		fprintf(out, "\tCPU %d: Processed %2d has finished\n", (int)a[0], (int)a[1]);
+		break;
+	case EV_CPU_STOP:
+		fprintf(out, "\tCPU %d stopped\n", (int)a[0]);
+		break;
+	case EV_READ:
+		fprintf(out, "read region=%d offset=%d value=%d\n", (int)a[0], (int)a[1], (int)a[2]);
+		break;
+	case EV_WRITE:
+		fprintf(out, "write region=%d offset=%d value=%d\n", (int)a[0], (int)a[1], (int)a[2]);
+		break;
+	case EV_PGTBL:
+		fprintf(out, "=== Page Table Dump ===\n");
+		break;
+	case EV_PTE: {
+		uint32_t pte = a[1];
+		fprintf(out, "PTE[%u]: 0x%08x | present=%d | fpn=%d | swapped=%d | swp_offset=%d\n",
+			(uint32_t)a[0],
+			pte,
+			(pte & PAGING_PTE_PRESENT_MASK) != 0,
+			PAGING_FPN(pte),
+			(pte & PAGING_PTE_SWAPPED_MASK) != 0,
+			PAGING_PTE_SWP(pte));
+		break;
+	}
+	case EV_MEMPHY:
+		fprintf(out, "MEMPHY Dump:\n");
+		break;
+	case EV_MEMPHY_BYTE:
+		fprintf(out, "Address %d: %02X\n", (int)a[0], (unsigned)a[1]);
+		break;
+	default:
+		fprintf(out, "<unknown event %u>\n", rec->type);
+	}
+}
+
+static struct evlog_ring_t * get_ring(void) {
+	if (my_ring == NULL) {
+		my_ring = (struct evlog_ring_t *)malloc(sizeof(struct evlog_ring_t));
+		atomic_init(&my_ring->head, 0);
+		atomic_init(&my_ring->tail, 0);
+		pthread_mutex_lock(&rings_lock);
+		my_ring->next = rings;
+		rings = my_ring;
+		pthread_mutex_unlock(&rings_lock);
+	}
+	return my_ring;
+}
+
+void evlog(enum evlog_type_t type, uint64_t a0, uint64_t a1, uint64_t a2,
+		const char * text) {
+	struct evlog_rec_t rec;
+	rec.type = type;
+	rec.len = (text == NULL) ? 0 : strlen(text);
+	rec.a[0] = a0;
+	rec.a[1] = a1;
+	rec.a[2] = a2;
+
+	if (!atomic_load_explicit(&enabled, memory_order_relaxed)) {
+		evlog_render(stdout, &rec, text);
+		return;
+	}
+
+	struct evlog_ring_t * ring = get_ring();
+	unsigned long nrec = 1 + REC_TEXT(rec.len);
+	unsigned long tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	/* Never drop an event: wait for the writer to make room */
+	struct timespec wait = { 0, 10000 };
+	while (tail + nrec - atomic_load_explicit(&ring->head, memory_order_acquire)
+			> EVLOG_RING_SIZE) {
+		nanosleep(&wait, NULL);
+	}
+
+	rec.seq = atomic_fetch_add_explicit(&next_seq, 1, memory_order_relaxed);
+	ring->rec[tail & (EVLOG_RING_SIZE - 1)] = rec;
+	for (unsigned long i = 1; i < nrec; i++) {
+		size_t off = (i - 1) * sizeof(struct evlog_rec_t);
+		size_t n = rec.len - off;
+		if (n > sizeof(struct evlog_rec_t)) n = sizeof(struct evlog_rec_t);
+		memcpy(&ring->rec[(tail + i) & (EVLOG_RING_SIZE - 1)], text + off, n);
+	}
+	atomic_store_explicit(&ring->tail, tail + nrec, memory_order_release);
+}
+
+/* Move what [ring] holds to the log file, return the records moved */
+static unsigned long drain_ring(struct evlog_ring_t * ring) {
+	unsigned long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	unsigned long tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	unsigned long n = tail - head;
+	if (n == 0) return 0;
+
+	unsigned long start = head & (EVLOG_RING_SIZE - 1);
+	unsigned long first = EVLOG_RING_SIZE - start;
+	if (first > n) first = n;
+	fwrite(&ring->rec[start], sizeof(struct evlog_rec_t), first, log_file);
+	fwrite(&ring->rec[0], sizeof(struct evlog_rec_t), n - first, log_file);
+	atomic_store_explicit(&ring->head, tail, memory_order_release);
+	return n;
+}
+
+static unsigned long drain_rings(void) {
+	unsigned long n = 0;
+	pthread_mutex_lock(&rings_lock);
+	for (struct evlog_ring_t * ring = rings; ring != NULL; ring = ring->next) {
+		n += drain_ring(ring);
+	}
+	pthread_mutex_unlock(&rings_lock);
+	return n;
+}
+
+static void * writer_routine(void * args) {
+	struct timespec idle = { 0, 100000 };
+	while (!atomic_load(&stopping)) {
+		if (drain_rings() == 0) {
+			nanosleep(&idle, NULL);
+		}
+	}
+	while (drain_rings() != 0)
+		;
+	pthread_exit(args);
+}
+
+int evlog_open(const char * path) {
+	if ((log_file = fopen(path, "wb")) == NULL) {
+		return -1;
+	}
+	uint32_t recsz = sizeof(struct evlog_rec_t);
+	fwrite(EVLOG_MAGIC, 1, strlen(EVLOG_MAGIC), log_file);
+	fwrite(&recsz, sizeof(recsz), 1, log_file);
+	atomic_store(&stopping, 0);
+	pthread_create(&writer, NULL, writer_routine, NULL);
+	atomic_store(&enabled, 1);
+	return 0;
+}
+
+void evlog_close(void) {
+	if (!atomic_load(&enabled)) return;
+	atomic_store(&stopping, 1);
+	pthread_join(writer, NULL);
+	atomic_store(&enabled, 0);
+	fclose(log_file);
+	log_file = NULL;
+	while (rings != NULL) {
+		struct evlog_ring_t * ring = rings;
+		rings = rings->next;
+		free(ring);
+	}
+	my_ring = NULL;
+}
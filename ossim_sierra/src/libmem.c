@@ -18,17 +18,27 @@
  #include "mm.h"
  #include "syscall.h"
  #include "libmem.h"
+ #include "evlog.h"
  #include <stdlib.h>
  
- /* Define PAGING_ADDR_SHIFT */
+ /* Define PAGING_ADDR_SHIFT, frames are PAGING_PAGESZ apart in storage */
  #ifndef PAGING_ADDR_SHIFT
- #define PAGING_ADDR_SHIFT 12 
+ #define PAGING_ADDR_SHIFT PAGING_ADDR_FPN_LOBIT
  #endif
  #include <stdio.h>
  #include <pthread.h>
+ #include <stdatomic.h>
  
  static pthread_mutex_t mmvm_lock = PTHREAD_MUTEX_INITIALIZER;
  
+ /* Accesses that found their page out of RAM */
+ static atomic_ulong nr_pg_faults = 0;
+ 
+ unsigned long mm_page_faults(void)
+ {
+   return atomic_load(&nr_pg_faults);
+ }
+ 
  /* enlist_vm_freerg_list - add new rg to freerg_list */
  int enlist_vm_freerg_list(struct mm_struct *mm, struct vm_rg_struct *rg_elmt)
  {
@@ -58,39 +68,32 @@
  int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr)
  {
    struct vm_rg_struct rgnode;
+   int ret = -1;
  
-   if (get_free_vmrg_area(caller, vmaid, size, &rgnode) == 0)
-   {
-     caller->mm->symrgtbl[rgid].rg_start = rgnode.rg_start;
-     caller->mm->symrgtbl[rgid].rg_end = rgnode.rg_end;
-     *alloc_addr = rgnode.rg_start;
- 
-     pthread_mutex_unlock(&mmvm_lock);
-     return 0;
-   }
- 
-   struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
-   int inc_sz = PAGING_PAGE_ALIGNSZ(size);
-   int inc_limit_ret;
+   pthread_mutex_lock(&mmvm_lock);
  
-   if (cur_vma == NULL)
-     return -1;
+   if (get_free_vmrg_area(caller, vmaid, size, &rgnode) != 0)
+   {
+     struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
  
-   inc_limit_ret = inc_vma_limit(caller, vmaid, inc_sz);
-   if (inc_limit_ret < 0)
-     return -1;
+     if (cur_vma == NULL)
+       goto out;
  
-   if (get_free_vmrg_area(caller, vmaid, size, &rgnode) == 0)
-   {
-     caller->mm->symrgtbl[rgid].rg_start = rgnode.rg_start;
-     caller->mm->symrgtbl[rgid].rg_end = rgnode.rg_end;
-     *alloc_addr = rgnode.rg_start;
+     if (inc_vma_limit(caller, vmaid, PAGING_PAGE_ALIGNSZ(size)) < 0)
+       goto out;
  
-     pthread_mutex_unlock(&mmvm_lock);
-     return 0;
+     if (get_free_vmrg_area(caller, vmaid, size, &rgnode) != 0)
+       goto out;
    }
  
-   return -1;
+   caller->mm->symrgtbl[rgid].rg_start = rgnode.rg_start;
+   caller->mm->symrgtbl[rgid].rg_end = rgnode.rg_end;
+   *alloc_addr = rgnode.rg_start;
+   ret = 0;
+ 
+ out:
+   pthread_mutex_unlock(&mmvm_lock);
+   return ret;
  }
  
  /* __free - remove a region memory */
@@ -103,7 +106,10 @@
    if (rgnode == NULL)
      return -1;
  
-   enlist_vm_freerg_list(caller->mm, rgnode);
+   /* The free list owns its nodes, the symbol table entry stays put */
+   struct vm_rg_struct *freerg = init_vm_rg(caller->mm->arena, rgnode->rg_start, rgnode->rg_end);
+   if (freerg != NULL && enlist_vm_freerg_list(caller->mm, freerg) != 0)
+     arena_free(caller->mm->arena, freerg, sizeof(struct vm_rg_struct));
  
    return 0;
  }
@@ -126,22 +132,42 @@
  {
    uint32_t pte = mm->pgd[pgn];
  
-   if (!PAGING_PAGE_PRESENT(pte))
+   if (!PAGING_PAGE_PRESENT(pte) || (pte & PAGING_PTE_SWAPPED_MASK))
    {
-     int vicpgn, swpfpn, tgtfpn;
+     int vicpgn, vicfpn, swpfpn, tgtswp;
+     long cost;
  
-     find_victim_page(caller->mm, &vicpgn);
-     MEMPHY_get_freefp(caller->active_mswp, &swpfpn);
+     atomic_fetch_add(&nr_pg_faults, 1);
  
-     tgtfpn = PAGING_PTE_SWP(pte);
- 
-     __mm_swap_page(caller, vicpgn, swpfpn);
-     __mm_swap_page(caller, tgtfpn, vicpgn);
+     /* No room in swap or nothing to evict: the access fails */
+     if (MEMPHY_get_freefp(caller->active_mswp, &swpfpn) != 0)
+       return -1;
+     MEMPHY_set_owner(caller->active_mswp, swpfpn, mm);
+     if (find_victim_page(caller->mm, &vicpgn) != 0)
+     {
+       MEMPHY_put_freefp(caller->active_mswp, swpfpn);
+       return -1;
+     }
  
+     /* The victim's frame goes to swap and is handed over to the page */
+     vicfpn = PAGING_FPN(mm->pgd[vicpgn]);
+     /* The time the swap device takes is owed by the faulting process */
+     cost = __mm_swap_page(caller, vicfpn, swpfpn);
+     if (cost > 0)
+       caller->io_wait += cost;
      pte_set_swap(&mm->pgd[vicpgn], 0, swpfpn);
-     pte_set_fpn(&mm->pgd[pgn], vicpgn);
  
-     enlist_pgn_node(&caller->mm->fifo_pgn, pgn);
+     if (PAGING_PAGE_PRESENT(pte))
+     {
+       tgtswp = PAGING_PTE_SWP(pte);
+       cost = __swap_cp_page(caller->active_mswp, tgtswp, caller->mram, vicfpn);
+       if (cost > 0)
+         caller->io_wait += cost;
+       MEMPHY_put_freefp(caller->active_mswp, tgtswp);
+     }
+     pte_set_fpn(&mm->pgd[pgn], vicfpn);
+ 
+     enlist_pgn_node(caller->mm->arena, &caller->mm->fifo_pgn, pgn);
    }
  
    *fpn = PAGING_FPN(mm->pgd[pgn]);
@@ -208,13 +234,12 @@ int libread(
     uint32_t offset,    // Source address = [source] + [offset]
     uint32_t* destination)
 {
-  BYTE data;
+  BYTE data = 0;
   int val = __read(proc, 0, source, offset, &data);
 
-  /* TODO update result of reading action*/
-  //destination 
+  *destination = data;
 #ifdef IODUMP
-  printf("read region=%d offset=%d value=%d\n", source, offset, data);
+  evlog(EV_READ, source, offset, data, NULL);
 #ifdef PAGETBL_DUMP
   print_pgtbl(proc, 0, -1); //print max TBL
 #endif
@@ -253,7 +278,7 @@ int libwrite(
     uint32_t offset)
 {
 #ifdef IODUMP
-  printf("write region=%d offset=%d value=%d\n", destination, offset, data);
+  evlog(EV_WRITE, destination, offset, data, NULL);
 #ifdef PAGETBL_DUMP
   print_pgtbl(proc, 0, -1); //print max TBL
 #endif
@@ -263,31 +288,65 @@ int libwrite(
   return __write(proc, 0, destination, offset, data);
 }
 
-/*free_pcb_memphy - collect all memphy of pcb
+/*free_pcb_memph - return the frames and swap slots of a pcb
  *@caller: caller
- *@vmaid: ID vm area to alloc memory region
- *@incpgnum: number of page
+ *
+ * __read/__write do not bound the offset against the region, so a page
+ * outside every VM area can be faulted in too: walk the whole page table.
+ * Frames are wiped on the way out so the next owner does not see this
+ * process' data, and only the ones recorded as held by this mm go back.
  */
 int free_pcb_memph(struct pcb_t *caller)
 {
-  int pagenum, fpn;
+  struct mm_struct *mm = caller->mm;
+  int nr_pages = 0, nr_fpn = 0, nr_swp = 0;
+  int pgn, fpn, swapped;
   uint32_t pte;
 
+  if (mm == NULL || mm->pgd == NULL)
+    return 0;
 
-  for(pagenum = 0; pagenum < PAGING_MAX_PGN; pagenum++)
-  {
-    pte= caller->mm->pgd[pagenum];
+  for (pgn = 0; pgn < PAGING_MAX_PGN; pgn++)
+    if (PAGING_PAGE_PRESENT(mm->pgd[pgn]))
+      nr_pages++;
+  if (nr_pages == 0)
+    return 0;
 
+  /* Frames fill the array from the front, swap slots from the back */
+  int *fpns = malloc(nr_pages * sizeof(int));
+  if (fpns == NULL)
+    return -1;
+
+  for (pgn = 0; pgn < PAGING_MAX_PGN; pgn++)
+  {
+    pte = mm->pgd[pgn];
     if (!PAGING_PAGE_PRESENT(pte))
+      continue;
+
+    mm->pgd[pgn] = 0;
+    swapped = (pte & PAGING_PTE_SWAPPED_MASK) != 0;
+    fpn = swapped ? PAGING_PTE_SWP(pte) : PAGING_FPN(pte);
+    /* A frame held by another mm is a stale entry, leave it to its holder */
+    if (MEMPHY_get_owner(swapped ? caller->active_mswp : caller->mram, fpn) != mm)
     {
-      fpn = PAGING_PTE_FPN(pte);
-      MEMPHY_put_freefp(caller->mram, fpn);
+      fprintf(stderr, "Error: page %d maps frame %d of another process\n", pgn, fpn);
+      continue;
+    }
+
+    if (swapped)
+    {
+      fpns[nr_pages - ++nr_swp] = fpn;
     } else {
-      fpn = PAGING_PTE_SWP(pte);
-      MEMPHY_put_freefp(caller->active_mswp, fpn);    
+      if ((fpn + 1) * PAGING_PAGESZ <= caller->mram->maxsz)
+        memset(caller->mram->storage + fpn * PAGING_PAGESZ, 0, PAGING_PAGESZ);
+      fpns[nr_fpn++] = fpn;
     }
   }
 
+  MEMPHY_put_freefps(caller->mram, fpns, nr_fpn);
+  MEMPHY_put_freefps(caller->active_mswp, fpns + nr_pages - nr_swp, nr_swp);
+  free(fpns);
+
   return 0;
 }
 
@@ -302,7 +361,7 @@ int free_pcb_memph(struct pcb_t *caller)
    *retpgn = pg->pgn;
    mm->fifo_pgn = pg->pg_next;
  
-   free(pg);
+   arena_free(mm->arena, pg, sizeof(struct pgn_t));
    return 0;
  }
  
@@ -323,7 +382,7 @@ int free_pcb_memph(struct pcb_t *caller)
        if (rgit->rg_start == rgit->rg_end)
        {
          cur_vma->vm_freerg_list = rgit->rg_next;
-         free(rgit);
+         arena_free(caller->mm->arena, rgit, sizeof(struct vm_rg_struct));
        }
  
        return 0;
@@ -341,17 +400,11 @@ int print_pgtbl(struct pcb_t *proc, uint32_t start, uint32_t end)
 
     if (end < 0 || end > PAGING_MAX_PGN) end = PAGING_MAX_PGN;
 
-    printf("=== Page Table Dump ===\n");
+    evlog(EV_PGTBL, 0, 0, 0, NULL);
     for (uint32_t i = start; i < end; i++) {
         uint32_t pte = proc->mm->pgd[i];
         if (pte != 0) {
-            printf("PTE[%u]: 0x%08x | present=%d | fpn=%d | swapped=%d | swp_offset=%d\n",
-                   i,
-                   pte,
-                   (pte & PAGING_PTE_PRESENT_MASK) != 0,
-                   PAGING_FPN(pte),
-                   (pte & PAGING_PTE_SWAPPED_MASK) != 0,
-                   PAGING_PTE_SWP(pte));
+            evlog(EV_PTE, i, pte, 0, NULL);
         }
     }
     return 0;
@@ -1,8 +1,15 @@
 
 #include "loader.h"
+#include "cpu.h"
+#include "arena.h"
+#include "mm.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 static uint32_t avail_pid = 1;
 
@@ -13,7 +20,8 @@ static uint32_t avail_pid = 1;
 #define OPT_WRITE	"write"
 #define OPT_SYSCALL	"syscall"
 
-static enum ins_opcode_t get_opcode(char * opt) {
+/* The opcode named [opt], -1 if there is none */
+static int get_opcode(char * opt) {
 	if (!strcmp(opt, OPT_CALC)) {
 		return CALC;
 	}else if (!strcmp(opt, OPT_ALLOC)) {
@@ -28,78 +36,305 @@ static enum ins_opcode_t get_opcode(char * opt) {
 		return SYSCALL;
 	}else{
 		printf("get_opcode return Opcode: %s\n", opt);
-		exit(1);
+		return -1;
 	}
 }
 
-struct pcb_t * load(const char * path) {
-	/* Create new PCB for the new process */
-	struct pcb_t * proc = (struct pcb_t * )malloc(sizeof(struct pcb_t));
-	proc->pid = avail_pid;
-	avail_pid++;
-	proc->page_table =
-		(struct page_table_t*)malloc(sizeof(struct page_table_t));
-	proc->bp = PAGE_SIZE;
-	proc->pc = 0;
+/* Code cache. Programs are parsed once per path and the segment is
+ * shared, read-only, by every process loaded from it. An entry is
+ * trusted as long as the file keeps the mtime and size it had when it
+ * was parsed. The cache holds one reference of its own on each segment
+ * until flush_code_cache(). */
+#define CODE_CACHE_BUCKETS 64
 
-	/* Read process code from file */
-	FILE * file;
-	if ((file = fopen(path, "r")) == NULL) {
-		printf("Cannot find process description at '%s'\n", path);
-		exit(1);		
-	}
-	snprintf(proc->path, 2*sizeof(path)+1, "%s", path);
+struct code_cache_entry_t {
+	char * path;
+	struct timespec mtime;
+	off_t size;
+	uint32_t priority;	/* Default priority in the description */
+	struct code_seg_t * code;
+	struct code_cache_entry_t * next;
+};
+
+static struct code_cache_entry_t * code_cache[CODE_CACHE_BUCKETS];
+static pthread_mutex_t code_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t code_cache_cond = PTHREAD_COND_INITIALIZER;
+
+static unsigned int hash_path(const char * path) {
+	unsigned int h = 5381;
+	while (*path) h = h * 33 + (unsigned char)*path++;
+	return h % CODE_CACHE_BUCKETS;
+}
+
+/* Parse the process description in [file], NULL if it is not one */
+static struct code_seg_t * parse_code(FILE * file, uint32_t * priority) {
 	char opcode[10];
-	proc->code = (struct code_seg_t*)malloc(sizeof(struct code_seg_t));
-	fscanf(file, "%u %u", &proc->priority, &proc->code->size);
-	proc->code->text = (struct inst_t*)malloc(
-		sizeof(struct inst_t) * proc->code->size
+	struct code_seg_t * code = (struct code_seg_t*)malloc(sizeof(struct code_seg_t));
+	if (fscanf(file, "%u %u", priority, &code->size) != 2) {
+		free(code);
+		return NULL;
+	}
+	code->text = (struct inst_t*)malloc(
+		sizeof(struct inst_t) * code->size
 	);
+	if (code->text == NULL && code->size > 0) {
+		free(code);
+		return NULL;
+	}
 	uint32_t i = 0;
 	char buf[200];
-	for (i = 0; i < proc->code->size; i++) {
-		fscanf(file, "%s", opcode);
-		proc->code->text[i].opcode = get_opcode(opcode);
-		switch(proc->code->text[i].opcode) {
+	for (i = 0; i < code->size; i++) {
+		int op;
+		if (fscanf(file, "%9s", opcode) != 1 || (op = get_opcode(opcode)) < 0) {
+			free(code->text);
+			free(code);
+			return NULL;
+		}
+		code->text[i].opcode = op;
+		switch(code->text[i].opcode) {
 		case CALC:
 			break;
 		case ALLOC:
 			fscanf(
 				file,
 				"%u %u\n",
-				&proc->code->text[i].arg_0,
-				&proc->code->text[i].arg_1
+				&code->text[i].arg_0,
+				&code->text[i].arg_1
 			);
 			break;
 		case FREE:
-			fscanf(file, "%u\n", &proc->code->text[i].arg_0);
+			fscanf(file, "%u\n", &code->text[i].arg_0);
 			break;
 		case READ:
 		case WRITE:
 			fscanf(
 				file,
 				"%u %u %u\n",
-				&proc->code->text[i].arg_0,
-				&proc->code->text[i].arg_1,
-				&proc->code->text[i].arg_2
+				&code->text[i].arg_0,
+				&code->text[i].arg_1,
+				&code->text[i].arg_2
 			);
 			break;	
 		case SYSCALL:
 			fgets(buf, sizeof(buf), file);
 			sscanf(buf, "%d%d%d%d",
-			           &proc->code->text[i].arg_0,
-			           &proc->code->text[i].arg_1,
-			           &proc->code->text[i].arg_2,
-			           &proc->code->text[i].arg_3
+			           &code->text[i].arg_0,
+			           &code->text[i].arg_1,
+			           &code->text[i].arg_2,
+			           &code->text[i].arg_3
 			);
 			break;
 		default:
 			printf("Opcode: %s\n", opcode);
-			exit(1);
+			free(code->text);
+			free(code);
+			return NULL;
 		}
 	}
+	code->map = NULL;
+	code->map_len = 0;
+	decode_code(code);
+	atomic_init(&code->refcount, 1);
+	return code;
+}
+
+/* Map the instructions of the compiled program in [file], NULL if it
+ * cannot be */
+static struct code_seg_t * map_code(FILE * file, const char * path,
+		size_t len, uint32_t * priority) {
+	void * map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+	if (map == MAP_FAILED) {
+		printf("Cannot map program at '%s'\n", path);
+		return NULL;
+	}
+	const struct prog_hdr_t * hdr = (const struct prog_hdr_t *)map;
+	if (len < sizeof(struct prog_hdr_t) ||
+	    len < sizeof(struct prog_hdr_t) + (size_t)hdr->size * sizeof(struct inst_t)) {
+		printf("Truncated program at '%s'\n", path);
+		munmap(map, len);
+		return NULL;
+	}
+	madvise(map, len, MADV_SEQUENTIAL);
+
+	struct code_seg_t * code = (struct code_seg_t*)malloc(sizeof(struct code_seg_t));
+	*priority = hdr->priority;
+	code->size = hdr->size;
+	code->text = (struct inst_t *)((char *)map + sizeof(struct prog_hdr_t));
+	code->map = map;
+	code->map_len = len;
+	decode_code(code);
+	atomic_init(&code->refcount, 1);
+	return code;
+}
+
+void release_code(struct code_seg_t * code) {
+	if (code == NULL) return;
+	if (atomic_fetch_sub(&code->refcount, 1) == 1) {
+		free(code->decoded);
+		if (code->map != NULL) {
+			munmap(code->map, code->map_len);
+		}else{
+			free(code->text);
+		}
+		free(code);
+	}
+}
+
+/* Get a reference on the code of the program at [path], NULL if it
+ * cannot be read. Threads asking for a program another thread is
+ * reading wait for its result rather than reading it again. */
+static struct code_seg_t * get_code(const char * path, uint32_t * priority) {
+	struct stat st;
+	if (stat(path, &st) != 0) {
+		printf("Cannot find process description at '%s'\n", path);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&code_cache_lock);
+	struct code_cache_entry_t ** slot = &code_cache[hash_path(path)];
+	struct code_cache_entry_t * entry;
+	while (1) {
+		entry = *slot;
+		while (entry != NULL && strcmp(entry->path, path) != 0) {
+			entry = entry->next;
+		}
+		if (entry == NULL || entry->code != NULL) break;
+		pthread_cond_wait(&code_cache_cond, &code_cache_lock);
+	}
+	if (entry != NULL &&
+	    entry->mtime.tv_sec == st.st_mtim.tv_sec &&
+	    entry->mtime.tv_nsec == st.st_mtim.tv_nsec &&
+	    entry->size == st.st_size) {
+		atomic_fetch_add(&entry->code->refcount, 1);
+		*priority = entry->priority;
+		pthread_mutex_unlock(&code_cache_lock);
+		return entry->code;
+	}
+
+	/* Claim the entry, a NULL code marks it as being read */
+	struct code_seg_t * old = NULL;
+	if (entry == NULL) {
+		entry = (struct code_cache_entry_t*)malloc(sizeof(struct code_cache_entry_t));
+		entry->path = strdup(path);
+		entry->next = *slot;
+		*slot = entry;
+	}else{
+		/* The file changed, running processes keep the old code */
+		old = entry->code;
+	}
+	entry->code = NULL;
+	pthread_mutex_unlock(&code_cache_lock);
+	release_code(old);
+
+	/* Read process code from file */
+	FILE * file;
+	struct code_seg_t * code = NULL;
+	if ((file = fopen(path, "r")) == NULL) {
+		printf("Cannot find process description at '%s'\n", path);
+	}else{
+		char magic[sizeof(((struct prog_hdr_t *)0)->magic)];
+		if (fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+		    memcmp(magic, PROG_MAGIC, sizeof(magic)) == 0) {
+			code = map_code(file, path, st.st_size, priority);
+		}else{
+			rewind(file);
+			code = parse_code(file, priority);
+		}
+		fclose(file);
+	}
+
+	pthread_mutex_lock(&code_cache_lock);
+	if (code == NULL) {
+		/* Give up the claim, a later reader tries again */
+		struct code_cache_entry_t ** it = slot;
+		while (*it != entry) it = &(*it)->next;
+		*it = entry->next;
+		free(entry->path);
+		free(entry);
+		pthread_cond_broadcast(&code_cache_cond);
+		pthread_mutex_unlock(&code_cache_lock);
+		return NULL;
+	}
+	entry->mtime = st.st_mtim;
+	entry->size = st.st_size;
+	entry->priority = *priority;
+	entry->code = code;
+	atomic_fetch_add(&code->refcount, 1);
+	pthread_cond_broadcast(&code_cache_cond);
+	pthread_mutex_unlock(&code_cache_lock);
+	return code;
+}
+
+void flush_code_cache(void) {
+	pthread_mutex_lock(&code_cache_lock);
+	for (int i = 0; i < CODE_CACHE_BUCKETS; i++) {
+		while (code_cache[i] != NULL) {
+			struct code_cache_entry_t * entry = code_cache[i];
+			code_cache[i] = entry->next;
+			release_code(entry->code);
+			free(entry->path);
+			free(entry);
+		}
+	}
+	pthread_mutex_unlock(&code_cache_lock);
+}
+
+char * resolve_path(const char * dir, const char * name, size_t len) {
+	size_t dlen = memchr(name, '/', len) ? 0 : strlen(dir);
+	char * path = (char*)malloc(dlen + len + 1);
+	memcpy(path, dir, dlen);
+	memcpy(path + dlen, name, len);
+	path[dlen + len] = '\0';
+	return path;
+}
+
+struct pcb_t * load_proc(const char * path) {
+	/* Create new PCB for the new process, in an arena it owns */
+	struct arena_t * arena = arena_create();
+	if (arena == NULL) {
+		printf("Cannot allocate process for '%s'\n", path);
+		exit(1);
+	}
+	struct pcb_t * proc = (struct pcb_t * )arena_alloc(arena, sizeof(struct pcb_t));
+	proc->arena = arena;
+	proc->pid = 0;
+	proc->page_table =
+		(struct page_table_t*)arena_alloc(arena, sizeof(struct page_table_t));
+	proc->bp = PAGE_SIZE;
+	proc->pc = 0;
+
+	proc->path = arena_strdup(arena, path);
+	proc->code = get_code(path, &proc->priority);
+	if (proc->code == NULL) {
+		exit(1);
+	}
 	return proc;
 }
 
+int check_program(const char * path) {
+	uint32_t priority;
+	struct code_seg_t * code = get_code(path, &priority);
+	if (code == NULL) return -1;
+	release_code(code);
+	return 0;
+}
+
+void free_proc(struct pcb_t * proc) {
+#ifdef MM_PAGING
+	free_pcb_memph(proc);
+#endif
+	release_code(proc->code);
+	arena_release(proc->arena);
+}
 
+void attach_pid(struct pcb_t * proc) {
+	proc->pid = avail_pid;
+	avail_pid++;
+}
+
+struct pcb_t * load(const char * path) {
+	struct pcb_t * proc = load_proc(path);
+	attach_pid(proc);
+	return proc;
+}
 
@@ -4,10 +4,76 @@
  * Memory physical module mm/mm-memphy.c
  */
 
+ #define _GNU_SOURCE /* O_DIRECT */
  #include "mm.h"
+ #include "evlog.h"
  #include <stdio.h>
  #include <stdlib.h>
  #include <string.h>
+ #include <errno.h>
+ #include <fcntl.h>
+ #include <unistd.h>
+ #include <sys/mman.h>
+ 
+ /* O_DIRECT transfers whole blocks of this size, from aligned memory */
+ #define MEMPHY_DIRECT_ALIGN 4096
+ 
+ /* Bytes of evicted frames a file device holds back to write as a run */
+ #define MEMPHY_WB_SIZE (MEMSWP_WB_PAGES * PAGING_PAGESZ)
+ 
+ /* The I/O state of a device is shared by every CPU: the cursor and its
+  * counters, and the write-back run of a file device */
+ static void io_lock(struct memphy_struct *mp)
+ {
+    while (atomic_flag_test_and_set_explicit(&mp->io_lock, memory_order_acquire))
+       ;
+ }
+ 
+ static void io_unlock(struct memphy_struct *mp)
+ {
+    atomic_flag_clear_explicit(&mp->io_lock, memory_order_release);
+ }
+ 
+ /*
+  *  MEMPHY_seek - move the cursor of a sequential device to @addr
+  *  @mp: memphy struct
+  *  @addr: address
+  *
+  *  The cursor travels the distance between the two addresses, it is
+  *  counted in seek_bytes. Returns the cost of the seek. Called with
+  *  io_lock held
+  */
+ static unsigned long MEMPHY_seek(struct memphy_struct *mp, int addr)
+ {
+    unsigned long dist = (addr > mp->cursor) ? (unsigned long)(addr - mp->cursor)
+                                             : (unsigned long)(mp->cursor - addr);
+ 
+    mp->cursor = addr;
+    mp->seek_bytes += dist;
+    return dist * mp->seek_cost;
+ }
+ 
+ /* Transfer accounting for @len bytes at the cursor, which ends past
+  * them. Called with io_lock held */
+ static unsigned long MEMPHY_xfer(struct memphy_struct *mp, int len)
+ {
+    mp->cursor = (mp->cursor + len) % mp->maxsz;
+    mp->xfer_bytes += len;
+    return (unsigned long)len * mp->xfer_cost;
+ }
+ 
+ /* Cost of @len bytes at @addr of a sequential device: a seek there, then
+  * the transfer, as one move of the cursor */
+ static long MEMPHY_seq_access(struct memphy_struct *mp, int addr, int len)
+ {
+    unsigned long cost;
+ 
+    io_lock(mp);
+    cost = MEMPHY_seek(mp, addr);
+    cost += MEMPHY_xfer(mp, len);
+    io_unlock(mp);
+    return (long)cost;
+ }
  
  /*
   *  MEMPHY_mv_csr - move MEMPHY cursor
@@ -16,16 +82,166 @@
   */
  int MEMPHY_mv_csr(struct memphy_struct *mp, int offset)
  {
-    int numstep = 0;
+    if (offset < 0 || offset >= mp->maxsz)
+       return -1;
  
-    mp->cursor = 0;
-    while (numstep < offset && numstep < mp->maxsz)
+    io_lock(mp);
+    MEMPHY_seek(mp, offset);
+    io_unlock(mp);
+    return 0;
+ }
+ 
+ /*
+  *  MEMPHY_set_cost - cost of a sequential device
+  *  @mp: memphy struct
+  *  @seek_cost: per byte the cursor travels
+  *  @xfer_cost: per byte transferred
+  *
+  *  Costs are in thousandths of an instruction time. Random access
+  *  devices cost nothing
+  */
+ void MEMPHY_set_cost(struct memphy_struct *mp, unsigned int seek_cost,
+                      unsigned int xfer_cost)
+ {
+    mp->seek_cost = seek_cost;
+    mp->xfer_cost = xfer_cost;
+ }
+ 
+ /*
+  * File devices. The content lives in a host file, storage is NULL.
+  * Writes are held back in a run of adjacent bytes, [wb_addr, wb_addr +
+  * wb_len), and go out with one pwrite when the next write does not
+  * extend the run or the run is full. Reads of the run are served from
+  * it. io_lock keeps the run and the bounce buffer to one CPU at a time
+  */
+ 
+ /* pread or pwrite all of @len bytes. Past the end of the file reads zeros */
+ static int MEMPHY_file_rw(struct memphy_struct *mp, long off, BYTE *buf, long len, int write)
+ {
+    while (len > 0)
+    {
+       ssize_t n = write ? pwrite(mp->fd, buf, len, off) : pread(mp->fd, buf, len, off);
+       mp->io_ops++;
+       if (n < 0 && errno == EINTR)
+          continue;
+       if (n < 0 || (n == 0 && write))
+          return -1;
+       if (n == 0)
+       {
+          memset(buf, 0, len);
+          break;
+       }
+       buf += n;
+       off += n;
+       len -= n;
+    }
+    return 0;
+ }
+ 
+ /* Transfer @len bytes at @off of the file. O_DIRECT goes through the
+  * bounce buffer in whole blocks, a write reads the blocks it only
+  * partly covers first */
+ static int MEMPHY_file_io(struct memphy_struct *mp, long off, BYTE *buf, long len, int write)
+ {
+    if (!mp->direct)
+       return MEMPHY_file_rw(mp, off, buf, len, write);
+ 
+    long start = off & ~(long)(MEMPHY_DIRECT_ALIGN - 1);
+    long end = (off + len + MEMPHY_DIRECT_ALIGN - 1) & ~(long)(MEMPHY_DIRECT_ALIGN - 1);
+    BYTE *bounce = mp->bounce_buf;
+ 
+    if (!write)
+    {
+       if (MEMPHY_file_rw(mp, start, bounce, end - start, 0) != 0)
+          return -1;
+       memcpy(buf, bounce + (off - start), len);
+       return 0;
+    }
+ 
+    long last = end - MEMPHY_DIRECT_ALIGN;
+    if (start != off &&
+        MEMPHY_file_rw(mp, start, bounce, MEMPHY_DIRECT_ALIGN, 0) != 0)
+       return -1;
+    if (end != off + len && (last != start || start == off) &&
+        MEMPHY_file_rw(mp, last, bounce + (last - start), MEMPHY_DIRECT_ALIGN, 0) != 0)
+       return -1;
+    memcpy(bounce + (off - start), buf, len);
+    return MEMPHY_file_rw(mp, start, bounce, end - start, 1);
+ }
+ 
+ /* Write out the held back run */
+ static int MEMPHY_wb_flush(struct memphy_struct *mp)
+ {
+    int ret = 0;
+ 
+    if (mp->wb_len > 0)
+       ret = MEMPHY_file_io(mp, mp->wb_addr, mp->wb_buf, mp->wb_len, 1);
+    mp->wb_len = 0;
+    return ret;
+ }
+ 
+ static int MEMPHY_file_load(struct memphy_struct *mp, int addr, BYTE *buf, int len)
+ {
+    int ret = 0;
+ 
+    io_lock(mp);
+    if (addr >= mp->wb_addr && addr + len <= mp->wb_addr + mp->wb_len)
+       memcpy(buf, mp->wb_buf + (addr - mp->wb_addr), len);
+    else if (addr < mp->wb_addr + mp->wb_len && addr + len > mp->wb_addr &&
+             MEMPHY_wb_flush(mp) != 0)
+       ret = -1;
+    else
+       ret = MEMPHY_file_io(mp, addr, buf, len, 0);
+    io_unlock(mp);
+    return ret;
+ }
+ 
+ static int MEMPHY_file_store(struct memphy_struct *mp, int addr, const BYTE *buf, int len)
+ {
+    int ret = 0;
+ 
+    io_lock(mp);
+    if (addr >= mp->wb_addr && addr + len <= mp->wb_addr + mp->wb_len)
     {
-       /* Traverse sequentially */
-       mp->cursor = (mp->cursor + 1) % mp->maxsz;
-       numstep++;
+       memcpy(mp->wb_buf + (addr - mp->wb_addr), buf, len);
     }
+    else if (mp->wb_len > 0 && addr == mp->wb_addr + mp->wb_len &&
+             mp->wb_len + len <= MEMPHY_WB_SIZE)
+    {
+       memcpy(mp->wb_buf + mp->wb_len, buf, len);
+       mp->wb_len += len;
+    }
+    else
+    {
+       ret = MEMPHY_wb_flush(mp);
+       if (ret == 0 && len <= MEMPHY_WB_SIZE)
+       {
+          memcpy(mp->wb_buf, buf, len);
+          mp->wb_addr = addr;
+          mp->wb_len = len;
+       }
+       else if (ret == 0)
+          ret = MEMPHY_file_io(mp, addr, (BYTE *)buf, len, 1);
+    }
+    io_unlock(mp);
+    return ret;
+ }
+ 
+ /* Copy @len bytes at @addr out of the device, whatever backs it */
+ static int MEMPHY_load(struct memphy_struct *mp, int addr, BYTE *buf, int len)
+ {
+    if (mp->storage == NULL)
+       return MEMPHY_file_load(mp, addr, buf, len);
+    memcpy(buf, mp->storage + addr, len);
+    return 0;
+ }
  
+ /* Copy @len bytes into the device at @addr */
+ static int MEMPHY_store(struct memphy_struct *mp, int addr, const BYTE *buf, int len)
+ {
+    if (mp->storage == NULL)
+       return MEMPHY_file_store(mp, addr, buf, len);
+    memcpy(mp->storage + addr, buf, len);
     return 0;
  }
  
@@ -40,11 +256,12 @@
     if (mp == NULL)
        return -1;
  
-    if (!mp->rdmflg)
+    if (mp->rdmflg)
        return -1; /* Not compatible mode for sequential read */
  
-    MEMPHY_mv_csr(mp, addr);
-    *value = (BYTE)mp->storage[addr];
+    if (MEMPHY_load(mp, addr, value, 1) != 0)
+       return -1;
+    MEMPHY_seq_access(mp, addr, 1);
  
     return 0;
  }
@@ -57,11 +274,13 @@
   */
  int MEMPHY_read(struct memphy_struct *mp, int addr, BYTE *value)
  {
-    if (mp == NULL)
+    if (mp == NULL || addr < 0 || addr >= mp->maxsz)
        return -1;
  
-    if (mp->rdmflg)
+    if (mp->rdmflg && mp->storage != NULL)
        *value = mp->storage[addr];
+    else if (mp->rdmflg)
+       return MEMPHY_file_load(mp, addr, value, 1);
     else /* Sequential access device */
        return MEMPHY_seq_read(mp, addr, value);
  
@@ -79,11 +298,12 @@
     if (mp == NULL)
        return -1;
  
-    if (!mp->rdmflg)
+    if (mp->rdmflg)
        return -1; /* Not compatible mode for sequential write */
  
-    MEMPHY_mv_csr(mp, addr);
-    mp->storage[addr] = value;
+    if (MEMPHY_store(mp, addr, &value, 1) != 0)
+       return -1;
+    MEMPHY_seq_access(mp, addr, 1);
  
     return 0;
  }
@@ -96,17 +316,102 @@
   */
  int MEMPHY_write(struct memphy_struct *mp, int addr, BYTE data)
  {
-    if (mp == NULL)
+    if (mp == NULL || addr < 0 || addr >= mp->maxsz)
        return -1;
  
-    if (mp->rdmflg)
+    if (mp->rdmflg && mp->storage != NULL)
        mp->storage[addr] = data;
+    else if (mp->rdmflg)
+       return MEMPHY_file_store(mp, addr, &data, 1);
     else /* Sequential access device */
        return MEMPHY_seq_write(mp, addr, data);
  
     return 0;
  }
  
+ /* Storage address of frame [fpn], -1 if it is not on the device */
+ static int MEMPHY_frame_addr(struct memphy_struct *mp, int fpn)
+ {
+    if (mp == NULL || fpn < 0 || (long)(fpn + 1) * PAGING_PAGESZ > mp->maxsz)
+       return -1;
+    return fpn * PAGING_PAGESZ;
+ }
+ 
+ /*
+  *  MEMPHY_read_page - read a whole frame of MEMPHY device
+  *  @mp: memphy struct
+  *  @fpn: frame page number
+  *  @buf: PAGING_PAGESZ bytes
+  *
+  *  Returns the cost of the access, -1 if the frame is not on the device
+  */
+ long MEMPHY_read_page(struct memphy_struct *mp, int fpn, BYTE *buf)
+ {
+    int addr = MEMPHY_frame_addr(mp, fpn);
+    if (addr < 0)
+       return -1;
+ 
+    if (MEMPHY_load(mp, addr, buf, PAGING_PAGESZ) != 0)
+       return -1;
+ 
+    return mp->rdmflg ? 0 : MEMPHY_seq_access(mp, addr, PAGING_PAGESZ);
+ }
+ 
+ /*
+  *  MEMPHY_write_page - write a whole frame of MEMPHY device
+  *  @mp: memphy struct
+  *  @fpn: frame page number
+  *  @buf: PAGING_PAGESZ bytes
+  *
+  *  Returns the cost of the access, -1 if the frame is not on the device
+  */
+ long MEMPHY_write_page(struct memphy_struct *mp, int fpn, const BYTE *buf)
+ {
+    int addr = MEMPHY_frame_addr(mp, fpn);
+    if (addr < 0)
+       return -1;
+ 
+    if (MEMPHY_store(mp, addr, buf, PAGING_PAGESZ) != 0)
+       return -1;
+ 
+    return mp->rdmflg ? 0 : MEMPHY_seq_access(mp, addr, PAGING_PAGESZ);
+ }
+ 
+ /*
+  *  MEMPHY_copy_page - copy a frame from one MEMPHY device to another
+  *  @mpsrc: source memphy
+  *  @srcfpn: source frame page number
+  *  @mpdst: destination memphy
+  *  @dstfpn: destination frame page number
+  *
+  *  Returns the cost of both accesses, -1 if a frame is not on its device
+  */
+ long MEMPHY_copy_page(struct memphy_struct *mpsrc, int srcfpn,
+                       struct memphy_struct *mpdst, int dstfpn)
+ {
+    int srcaddr = MEMPHY_frame_addr(mpsrc, srcfpn);
+    int dstaddr = MEMPHY_frame_addr(mpdst, dstfpn);
+    BYTE buf[PAGING_PAGESZ];
+ 
+    if (srcaddr < 0 || dstaddr < 0)
+       return -1;
+ 
+    if (mpsrc->rdmflg && mpdst->rdmflg && mpsrc->storage != NULL && mpdst->storage != NULL)
+    {
+       /* memmove: a frame may be copied onto itself */
+       memmove(mpdst->storage + dstaddr, mpsrc->storage + srcaddr, PAGING_PAGESZ);
+       return 0;
+    }
+ 
+    long rcost = MEMPHY_read_page(mpsrc, srcfpn, buf);
+    if (rcost < 0)
+       return -1;
+    long wcost = MEMPHY_write_page(mpdst, dstfpn, buf);
+    if (wcost < 0)
+       return -1;
+    return rcost + wcost;
+ }
+ 
  /*
   *  MEMPHY_format - format MEMPHY device
   *  @mp: memphy struct
@@ -115,30 +420,52 @@
  int MEMPHY_format(struct memphy_struct *mp, int pagesz)
  {
     int numfp = mp->maxsz / pagesz;
-    struct framephy_struct *newfst, *fst;
-    int iter = 0;
  
+    mp->maxfp = 0;
+    mp->free_fp_stack = NULL;
+    mp->fp_state = NULL;
+    mp->fp_owner = NULL;
+    mp->nr_stacked_fp = 0;
+    mp->fp_fresh = 0;
+    mp->nr_free_fp = 0;
+    mp->trim_span = 0;
+    mp->trim_pending = -1;
     if (numfp <= 0)
        return -1;
  
-    /* Initialize head of free framephy list */
-    fst = malloc(sizeof(struct framephy_struct));
-    fst->fpn = iter;
-    mp->free_fp_list = fst;
+    /* Every frame starts fresh, the arrays are only touched as frames
+     * are used, a large swap costs no more than a small one */
+    mp->free_fp_stack = malloc(numfp * sizeof(int));
+    mp->fp_state = calloc(numfp, sizeof(BYTE));
+    mp->fp_owner = calloc(numfp, sizeof(struct mm_struct *));
+    if (mp->free_fp_stack == NULL || mp->fp_state == NULL || mp->fp_owner == NULL)
+       return -1;
  
-    /* Fill in the rest of the free frame list */
-    for (iter = 1; iter < numfp; iter++)
+    mp->maxfp = numfp;
+    mp->nr_free_fp = numfp;
+    /* Host pages of the storage are handed back once all their frames
+     * are free, a file device has none. Both sizes are powers of two */
+    if (mp->storage != NULL)
     {
-       newfst = malloc(sizeof(struct framephy_struct));
-       newfst->fpn = iter;
-       newfst->fp_next = NULL;
-       fst->fp_next = newfst;
-       fst = newfst;
+       long span = sysconf(_SC_PAGESIZE) / pagesz;
+       mp->trim_span = (span > 1) ? span : 1;
     }
  
     return 0;
  }
  
+ /* The pool is held for a few moves at a time */
+ static void fp_lock(struct memphy_struct *mp)
+ {
+    while (atomic_flag_test_and_set_explicit(&mp->fp_lock, memory_order_acquire))
+       ;
+ }
+ 
+ static void fp_unlock(struct memphy_struct *mp)
+ {
+    atomic_flag_clear_explicit(&mp->fp_lock, memory_order_release);
+ }
+ 
  /*
   *  MEMPHY_get_freefp - get a free frame from MEMPHY
   *  @mp: memphy struct
@@ -146,18 +473,134 @@
   */
  int MEMPHY_get_freefp(struct memphy_struct *mp, int *retfpn)
  {
-    struct framephy_struct *fp = mp->free_fp_list;
+    int fpn;
+ 
+    while (1)
+    {
+       fp_lock(mp);
+       if (mp->nr_stacked_fp > 0)
+          fpn = mp->free_fp_stack[mp->nr_stacked_fp - 1];
+       else if (mp->fp_fresh < mp->maxfp)
+          fpn = mp->fp_fresh;
+       else
+       {
+          fp_unlock(mp);
+          return -1;
+       }
+       if (mp->fp_state[fpn] != FP_TRIM)
+          break;
+       /* Its host page is on the way back, see MEMPHY_trim() */
+       fp_unlock(mp);
+       while (__atomic_load_n(&mp->fp_state[fpn], __ATOMIC_ACQUIRE) == FP_TRIM)
+          ;
+    }
+    if (mp->nr_stacked_fp > 0)
+       mp->nr_stacked_fp--;
+    else
+       mp->fp_fresh++;
+    mp->fp_state[fpn] = FP_USED;
+    mp->nr_free_fp--;
+    fp_unlock(mp);
+ 
+    *retfpn = fpn;
+    return 0;
+ }
  
-    if (fp == NULL)
+ /*
+  *  MEMPHY_set_owner - record the holder of a used frame
+  *  @mp: memphy struct
+  *  @fpn: frame page number
+  *  @owner: mm holding the frame
+  */
+ int MEMPHY_set_owner(struct memphy_struct *mp, int fpn, struct mm_struct *owner)
+ {
+    if (fpn < 0 || fpn >= mp->maxfp || mp->fp_state[fpn] != FP_USED)
        return -1;
  
-    *retfpn = fp->fpn;
-    mp->free_fp_list = fp->fp_next;
+    mp->fp_owner[fpn] = owner;
+    return 0;
+ }
  
-    /* Free the used frame node */
-    free(fp);
+ /* Holder of frame @fpn, NULL if it is free or was never claimed */
+ struct mm_struct *MEMPHY_get_owner(struct memphy_struct *mp, int fpn)
+ {
+    if (fpn < 0 || fpn >= mp->maxfp)
+       return NULL;
+    return mp->fp_owner[fpn];
+ }
  
-    return 0;
+ /* Frames past the host page at @first, or the end of the device */
+ static int MEMPHY_page_end(struct memphy_struct *mp, int first)
+ {
+    return (first + mp->trim_span < mp->maxfp) ? first + mp->trim_span : mp->maxfp;
+ }
+ 
+ /* Whether no frame of the host page at @first is in @state */
+ static int MEMPHY_page_clear(struct memphy_struct *mp, int first, BYTE state)
+ {
+    return memchr(mp->fp_state + first, state, MEMPHY_page_end(mp, first) - first) == NULL;
+ }
+ 
+ /*
+  *  MEMPHY_pick_trim - pick the host pages that hold no used frame any more
+  *  @mp: memphy struct
+  *  @fpns: frames just freed
+  *  @n: number of frames
+  *  @pages: first frame of each page to give back, room for @n
+  *
+  *  Called with the pool locked. The frames of a picked page go to
+  *  FP_TRIM, MEMPHY_get_freefp() waits for MEMPHY_trim() before handing
+  *  one out: the page is handed back after the lock is dropped, and
+  *  reads as zero again, as before its first use. The page freed last
+  *  is held back until another one takes its place, a frame taken and
+  *  given back over and over would otherwise cost a madvise and a host
+  *  fault each time. Returns how many pages were picked.
+  */
+ static int MEMPHY_pick_trim(struct memphy_struct *mp, const int *fpns, int n, int *pages)
+ {
+    int span = mp->trim_span;
+    int nr_pages = 0;
+ 
+    if (span == 0)
+       return 0;
+    for (int i = 0; i < n; i++)
+    {
+       int first = fpns[i] & -span;
+       if (fpns[i] < 0 || fpns[i] >= mp->maxfp || first == mp->trim_pending ||
+           !MEMPHY_page_clear(mp, first, FP_USED))
+          continue;
+       first = mp->trim_pending;
+       mp->trim_pending = fpns[i] & -span;
+       /* A page another thread is handing back is left to it */
+       if (first < 0 || !MEMPHY_page_clear(mp, first, FP_USED) ||
+           !MEMPHY_page_clear(mp, first, FP_TRIM))
+          continue;
+       memset(mp->fp_state + first, FP_TRIM, MEMPHY_page_end(mp, first) - first);
+       pages[nr_pages++] = first;
+    }
+    return nr_pages;
+ }
+ 
+ /*
+  *  MEMPHY_trim - hand back the pages MEMPHY_pick_trim() picked
+  *  @mp: memphy struct
+  *  @pages: first frame of each page
+  *  @n: number of pages
+  *
+  *  Called with the pool unlocked, nobody else touches the frames.
+  */
+ static void MEMPHY_trim(struct memphy_struct *mp, const int *pages, int n)
+ {
+    for (int i = 0; i < n; i++)
+       madvise(mp->storage + (long)pages[i] * PAGING_PAGESZ,
+               (long)(MEMPHY_page_end(mp, pages[i]) - pages[i]) * PAGING_PAGESZ,
+               MADV_DONTNEED);
+ 
+    fp_lock(mp);
+    for (int i = 0; i < n; i++)
+       for (int fpn = pages[i]; fpn < MEMPHY_page_end(mp, pages[i]); fpn++)
+          __atomic_store_n(&mp->fp_state[fpn], FP_FREE, __ATOMIC_RELEASE);
+    fp_unlock(mp);
  }
  
  /*
@@ -167,15 +610,84 @@
   */
  int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn)
  {
-    struct framephy_struct *fp = mp->free_fp_list;
-    struct framephy_struct *newnode = malloc(sizeof(struct framephy_struct));
+    return MEMPHY_put_freefps(mp, &fpn, 1);
+ }
  
-    /* Create a new node with the given frame page number */
-    newnode->fpn = fpn;
-    newnode->fp_next = fp;
-    mp->free_fp_list = newnode;
+ /*
+  *  MEMPHY_put_freefps - return frames to the free list at once
+  *  @mp: memphy struct
+  *  @fpns: frame page numbers
+  *  @n: number of frames
+  *
+  *  Frames that are not in use are left alone, -1 if there were any.
+  *  Host pages left with no used frame go back to the host, see
+  *  MEMPHY_pick_trim().
+  */
+ int MEMPHY_put_freefps(struct memphy_struct *mp, const int *fpns, int n)
+ {
+    int ret = 0, nr_pages;
+    int few_pages[16];
+    int *pages = (n <= 16) ? few_pages : malloc(n * sizeof(int));
  
-    return 0;
+    fp_lock(mp);
+    for (int i = 0; i < n; i++)
+    {
+       int fpn = fpns[i];
+       if (fpn < 0 || fpn >= mp->maxfp || mp->fp_state[fpn] != FP_USED)
+       {
+          ret = -1;
+          continue;
+       }
+       mp->fp_state[fpn] = FP_FREE;
+       mp->fp_owner[fpn] = NULL;
+       mp->free_fp_stack[mp->nr_stacked_fp++] = fpn;
+       mp->nr_free_fp++;
+    }
+    nr_pages = (pages != NULL) ? MEMPHY_pick_trim(mp, fpns, n, pages) : 0;
+    fp_unlock(mp);
+ 
+    if (nr_pages > 0)
+       MEMPHY_trim(mp, pages, nr_pages);
+    if (pages != few_pages)
+       free(pages);
+    return ret;
+ }
+ 
+ /*
+  *  MEMPHY_free_list - list the free frames in the order they will be
+  *  handed out, for dumps and debugging. The caller frees the nodes.
+  *  @mp: memphy struct
+  */
+ struct framephy_struct *MEMPHY_free_list(struct memphy_struct *mp)
+ {
+    struct framephy_struct *head = NULL, *fp;
+    int fpn;
+ 
+    /* Built back to front: fresh frames last, top of the stack first */
+    fp_lock(mp);
+    for (fpn = mp->maxfp - 1; fpn >= mp->fp_fresh; fpn--)
+    {
+       fp = malloc(sizeof(struct framephy_struct));
+       if (fp == NULL)
+          break;
+       fp->fpn = fpn;
+       fp->owner = NULL;
+       fp->fp_next = head;
+       head = fp;
+    }
+    for (int i = 0; i < mp->nr_stacked_fp; i++)
+    {
+       fp = malloc(sizeof(struct framephy_struct));
+       if (fp == NULL)
+          break;
+       fp->fpn = mp->free_fp_stack[i];
+       fp->owner = NULL;
+       fp->fp_next = head;
+       head = fp;
+    }
+    fp_unlock(mp);
+ 
+    return head;
  }
  
  /*
@@ -184,11 +696,24 @@
   */
  int MEMPHY_dump(struct memphy_struct *mp)
  {
-    printf("MEMPHY Dump:\n");
-    for (int i = 0; i < mp->maxsz; i++)
+    BYTE chunk[PAGING_PAGESZ];
+    int end = mp->maxsz;
+ 
+    /* Frames past the fresh mark were never handed out and read as zero */
+    if (mp->maxfp > 0 && mp->fp_fresh < mp->maxfp)
+       end = mp->fp_fresh * PAGING_PAGESZ;
+ 
+    evlog(EV_MEMPHY, 0, 0, 0, NULL);
+    for (int addr = 0; addr < end; addr += PAGING_PAGESZ)
     {
-       if (mp->storage[i] != 0)
-          printf("Address %d: %02X\n", i, mp->storage[i]);
+       int len = (end - addr < PAGING_PAGESZ) ? end - addr : PAGING_PAGESZ;
+       if (MEMPHY_load(mp, addr, chunk, len) != 0)
+          return -1;
+       for (int i = 0; i < len; i++)
+       {
+          if (chunk[i] != 0)
+             evlog(EV_MEMPHY_BYTE, addr + i, chunk[i], 0, NULL);
+       }
     }
     return 0;
  }
@@ -201,18 +726,127 @@
   */
  int init_memphy(struct memphy_struct *mp, int max_size, int randomflg)
  {
-    mp->storage = (BYTE *)malloc(max_size * sizeof(BYTE));
-    mp->maxsz = max_size;
-    memset(mp->storage, 0, max_size * sizeof(BYTE));
+    /* Demand-zero storage: the host backs a page of the device the
+     * first time it is written, untouched frames cost no memory. An
+     * unused device (size 0) has no storage and no frames */
+    void *storage = NULL;
+    if (max_size > 0)
+    {
+       storage = mmap(NULL, max_size * sizeof(BYTE), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+       if (storage == MAP_FAILED)
+          storage = NULL;
+    }
+    mp->storage = (BYTE *)storage;
+    mp->maxsz = (storage != NULL) ? max_size : 0;
+    atomic_flag_clear(&mp->fp_lock);
+    mp->fd = -1;
+    mp->direct = 0;
+    mp->wb_buf = NULL;
+    mp->bounce_buf = NULL;
+    mp->wb_addr = 0;
+    mp->wb_len = 0;
+    mp->io_ops = 0;
+    atomic_flag_clear(&mp->io_lock);
  
     MEMPHY_format(mp, PAGING_PAGESZ);
  
     mp->rdmflg = (randomflg != 0) ? 1 : 0;
+    mp->cursor = 0;
+    mp->seek_bytes = 0;
+    mp->xfer_bytes = 0;
+    MEMPHY_set_cost(mp, 0, 0);
+ 
+    return (max_size > 0 && storage == NULL) ? -1 : 0;
+ }
+ 
+ /*
+  *  init_memphy_file - initialize a MEMPHY device kept in a host file
+  *  @mp: memphy struct
+  *  @max_size: maximum size of memory
+  *  @randomflg: random access flag
+  *  @path: backing file, created or truncated
+  *  @direct: bypass the host page cache with O_DIRECT
+  */
+ int init_memphy_file(struct memphy_struct *mp, int max_size, int randomflg,
+                      const char *path, int direct)
+ {
+    int flags = O_RDWR | O_CREAT | O_TRUNC;
+    /* The file has whole blocks, O_DIRECT never reads short of a frame */
+    long fsize = ((long)max_size + MEMPHY_DIRECT_ALIGN - 1) & ~(long)(MEMPHY_DIRECT_ALIGN - 1);
+    void *wb_buf = NULL, *bounce_buf = NULL;
+    int fd;
+ 
+    init_memphy(mp, 0, randomflg);
+    if (max_size <= 0)
+       return -1;
+ 
+    if (direct)
+    {
+ #ifdef O_DIRECT
+       flags |= O_DIRECT;
+ #else
+       return -1;
+ #endif
+    }
+    fd = open(path, flags, 0600);
+    if (fd < 0)
+       return -1;
  
-    if (!mp->rdmflg) /* Not random access device, then it is sequential */
-       mp->cursor = 0;
+    /* The bounce buffer takes a run and the blocks at both of its ends */
+    if (ftruncate(fd, fsize) != 0 ||
+        posix_memalign(&wb_buf, MEMPHY_DIRECT_ALIGN, MEMPHY_WB_SIZE) != 0 ||
+        (direct && posix_memalign(&bounce_buf, MEMPHY_DIRECT_ALIGN,
+                                  MEMPHY_WB_SIZE + 2 * MEMPHY_DIRECT_ALIGN) != 0))
+    {
+       free(wb_buf);
+       close(fd);
+       return -1;
+    }
+ 
+    mp->fd = fd;
+    mp->direct = direct ? 1 : 0;
+    mp->wb_buf = (BYTE *)wb_buf;
+    mp->bounce_buf = (BYTE *)bounce_buf;
+    mp->maxsz = max_size;
+    MEMPHY_format(mp, PAGING_PAGESZ);
  
     return 0;
  }
  
+ /*
+  *  MEMPHY_sync - write out what a file device holds back
+  *  @mp: memphy struct
+  */
+ int MEMPHY_sync(struct memphy_struct *mp)
+ {
+    int ret;
+ 
+    if (mp->fd < 0)
+       return 0;
+    io_lock(mp);
+    ret = MEMPHY_wb_flush(mp);
+    io_unlock(mp);
+    return ret;
+ }
+ 
+ /*
+  *  MEMPHY_release - give back everything a device holds
+  *  @mp: memphy struct
+  */
+ void MEMPHY_release(struct memphy_struct *mp)
+ {
+    MEMPHY_sync(mp);
+    if (mp->fd >= 0)
+       close(mp->fd);
+    if (mp->storage != NULL)
+       munmap(mp->storage, mp->maxsz);
+    free(mp->wb_buf);
+    free(mp->bounce_buf);
+    free(mp->free_fp_stack);
+    free(mp->fp_state);
+    free(mp->fp_owner);
+    init_memphy(mp, 0, mp->rdmflg);
+ }
+ 
  // #endif
\ No newline at end of file
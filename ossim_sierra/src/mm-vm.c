@@ -37,10 +37,9 @@ struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid)
 }
 
 
-int __mm_swap_page(struct pcb_t *caller, int vicfpn , int swpfpn)
+long __mm_swap_page(struct pcb_t *caller, int vicfpn , int swpfpn)
 {
-    __swap_cp_page(caller->mram, vicfpn, caller->active_mswp, swpfpn);
-    return 0;
+    return __swap_cp_page(caller->mram, vicfpn, caller->active_mswp, swpfpn);
 }
 
 
@@ -54,7 +53,7 @@ int __mm_swap_page(struct pcb_t *caller, int vicfpn , int swpfpn)
  */
 struct vm_rg_struct *get_vm_area_node_at_brk(struct pcb_t *caller, int vmaid, int size, int alignedsz)
 {
-  struct vm_rg_struct *newrg = malloc(sizeof(struct vm_rg_struct));
+  struct vm_rg_struct *newrg = arena_alloc(caller->mm->arena, sizeof(struct vm_rg_struct));
   struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
 
   /* Update the new region boundary */
@@ -103,7 +102,7 @@ int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, int vmastart, int
  */
 int inc_vma_limit(struct pcb_t *caller, int vmaid, int inc_sz)
 {
-  struct vm_rg_struct *newrg = malloc(sizeof(struct vm_rg_struct));
+  struct vm_rg_struct newrg;
   int inc_amt = PAGING_PAGE_ALIGNSZ(inc_sz);
   int incnumpage = inc_amt / PAGING_PAGESZ;
   struct vm_rg_struct *area = get_vm_area_node_at_brk(caller, vmaid, inc_sz, inc_amt);
@@ -113,16 +112,19 @@ int inc_vma_limit(struct pcb_t *caller, int vmaid, int inc_sz)
 
   /* Validate overlap of obtained region */
   if (validate_overlap_vm_area(caller, vmaid, area->rg_start, area->rg_end) < 0)
+  {
+    arena_free(caller->mm->arena, area, sizeof(struct vm_rg_struct));
     return -1; /* Overlap and failed allocation */
+  }
 
   /* Update the vm_end to reflect the new limit */
   cur_vma->vm_end = area->rg_end;
 
   /* Map the memory to MEMRAM */
-  if (vm_map_ram(caller, area->rg_start, area->rg_end, old_end, incnumpage, newrg) < 0)
-    return -1;
+  int ret = vm_map_ram(caller, area->rg_start, area->rg_end, old_end, incnumpage, &newrg);
+  arena_free(caller->mm->arena, area, sizeof(struct vm_rg_struct));
 
-  return 0;
+  return (ret < 0) ? -1 : 0;
 }
 
 // #endif
\ No newline at end of file
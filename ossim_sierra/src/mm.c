@@ -89,15 +89,24 @@ int pte_set_fpn(uint32_t *pte, int fpn)
  
      for (pgit = 0; pgit < req_pgnum; pgit++) {
          if (MEMPHY_get_freefp(caller->mram, &fpn) == 0) { // Get a free frame
-             newfp_str = malloc(sizeof(struct framephy_struct));
+             MEMPHY_set_owner(caller->mram, fpn, caller->mm);
+             newfp_str = arena_alloc(caller->mm->arena, sizeof(struct framephy_struct));
              if (newfp_str == NULL) { 
                  fprintf(stderr, "Error: Memory allocation failed\n");
                  return -1;
              }
              newfp_str->fpn = fpn;
+             newfp_str->owner = caller->mm;
              newfp_str->fp_next = *frm_lst;
              *frm_lst = newfp_str; // Add to the frame list
          } else {
+             /* Give back the frames taken so far */
+             while (*frm_lst != NULL) {
+                 newfp_str = *frm_lst;
+                 *frm_lst = newfp_str->fp_next;
+                 MEMPHY_put_freefp(caller->mram, newfp_str->fpn);
+                 arena_free(caller->mm->arena, newfp_str, sizeof(struct framephy_struct));
+             }
              return -1; // Error: Not enough frames available
          }
      }
@@ -132,7 +141,7 @@ int pte_set_fpn(uint32_t *pte, int fpn)
  
    
      for (int i = 0; i < pgit; i++) {
-         enlist_pgn_node(&caller->mm->fifo_pgn, pgn + i);
+         enlist_pgn_node(caller->mm->arena, &caller->mm->fifo_pgn, pgn + i);
      }
  
      return 0;
@@ -155,6 +164,13 @@ int pte_set_fpn(uint32_t *pte, int fpn)
      /* Map the allocated frames to the virtual address range */
      vmap_page_range(caller, mapstart, incpgnum, frm_lst, ret_rg);
  
+     /* The page table records the frames now */
+     while (frm_lst != NULL) {
+         struct framephy_struct *fp_next = frm_lst->fp_next;
+         arena_free(caller->mm->arena, frm_lst, sizeof(struct framephy_struct));
+         frm_lst = fp_next;
+     }
+ 
      return 0;
  }
  
@@ -164,42 +180,31 @@ int pte_set_fpn(uint32_t *pte, int fpn)
  * @mpdst  : destination memphy
  * @dstfpn : destination physical page number (FPN)
  **/
-int __swap_cp_page(struct memphy_struct *mpsrc, int srcfpn,
+long __swap_cp_page(struct memphy_struct *mpsrc, int srcfpn,
     struct memphy_struct *mpdst, int dstfpn)
 {
-int cellidx;
-int addrsrc, addrdst;
-for (cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++)
-{
-addrsrc = srcfpn * PAGING_PAGESZ + cellidx;
-addrdst = dstfpn * PAGING_PAGESZ + cellidx;
-
-BYTE data;
-MEMPHY_read(mpsrc, addrsrc, &data);
-MEMPHY_write(mpdst, addrdst, data);
-}
-
-return 0;
+return MEMPHY_copy_page(mpsrc, srcfpn, mpdst, dstfpn);
 }
 
 
  /*
-  * Initialize a empty Memory Management instance
+  * Initialize a empty Memory Management instance, its metadata comes
+  * from the arena of the owner and goes away with it
   * @mm:     self mm
   * @caller: mm owner
   */
  int init_mm(struct mm_struct *mm, struct pcb_t *caller)
  {
-     struct vm_area_struct *vma0 = malloc(sizeof(struct vm_area_struct));
+     mm->arena = caller->arena;
+     struct vm_area_struct *vma0 = arena_alloc(mm->arena, sizeof(struct vm_area_struct));
      if (vma0 == NULL) {
          fprintf(stderr, "Error: Memory allocation failed for VMA\n");
          return -1;
      }
  
-     mm->pgd = malloc(PAGING_MAX_PGN * sizeof(uint32_t));
+     mm->pgd = arena_alloc(mm->arena, PAGING_MAX_PGN * sizeof(uint32_t));
      if (mm->pgd == NULL) {
          fprintf(stderr, "Error: Memory allocation failed for page table\n");
-         free(vma0);
          return -1;
      }
  
@@ -211,7 +216,8 @@ return 0;
      vma0->vm_end = vma0->vm_start;
      vma0->sbrk = vma0->vm_start;
  
-     struct vm_rg_struct *first_rg = init_vm_rg(vma0->vm_start, vma0->vm_end);
+     vma0->vm_freerg_list = NULL;
+     struct vm_rg_struct *first_rg = init_vm_rg(mm->arena, vma0->vm_start, vma0->vm_end);
      enlist_vm_rg_node(&vma0->vm_freerg_list, first_rg);
  
      vma0->vm_mm = mm;
@@ -222,11 +228,12 @@ return 0;
  
      return 0;
  }
+ 
  #include <stdlib.h>
 
 /* Create a new vm_rg_struct with start and end addresses */
-struct vm_rg_struct *init_vm_rg(int rg_start, int rg_end) {
-    struct vm_rg_struct *newrg = malloc(sizeof(struct vm_rg_struct));
+struct vm_rg_struct *init_vm_rg(struct arena_t *arena, int rg_start, int rg_end) {
+    struct vm_rg_struct *newrg = arena_alloc(arena, sizeof(struct vm_rg_struct));
     if (newrg == NULL) return NULL;
 
     newrg->rg_start = rg_start;
@@ -245,8 +252,8 @@ int enlist_vm_rg_node(struct vm_rg_struct **rglist, struct vm_rg_struct *rgnode)
 }
 
 /* Enlist a page number node into the FIFO page list */
-int enlist_pgn_node(struct pgn_t **pgnlist, int pgn) {
-    struct pgn_t *newpgn = malloc(sizeof(struct pgn_t));
+int enlist_pgn_node(struct arena_t *arena, struct pgn_t **pgnlist, int pgn) {
+    struct pgn_t *newpgn = arena_alloc(arena, sizeof(struct pgn_t));
     if (newpgn == NULL) return -1;
 
     newpgn->pgn = pgn;
@@ -3,19 +3,30 @@
 #include "sched.h"
 #include "loader.h"
 #include "mm.h"
+#include "arena.h"
+#include "evlog.h"
+#include "ctl.h"
 
 #include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/resource.h>
 
 static int time_slot;
 static int num_cpus;
 static int done = 0;
+static enum sched_policy_t sched_policy = SCHED_MLQ;
+static int ins_per_slot = 1;	/* Instructions a CPU executes per time slot */
 
 #ifdef MM_PAGING
 static int memramsz;
 static int memswpsz[PAGING_MAX_MMSWP];
+static char * memswpfile[PAGING_MAX_MMSWP];	/* Host file of a swap, NULL: in memory */
+static int memswpdirect[PAGING_MAX_MMSWP];	/* The file is opened O_DIRECT */
 
 struct mmpaging_ld_args {
 	/* A dispatched argument struct to compact many-fields passing to loader */
@@ -28,117 +39,585 @@ struct mmpaging_ld_args {
 };
 #endif
 
-static struct ld_args{
-	char ** path;
-	unsigned long * start_time;
-#ifdef MLQ_SCHED
-	unsigned long * prio;
-#endif
-} ld_processes;
+/* An arrival listed in the configuration */
+struct ld_arrival_t {
+	unsigned long start_time;
+	unsigned long prio;
+	unsigned long seq;	/* Line number, keeps equal start times in file order */
+	char * path;
+	struct pcb_t * proc;	/* Read program, NULL until ready */
+};
 int num_processes;
+static unsigned long nr_loaded = 0;	/* Processes attached so far */
+
+/* Arrival lines are read lazily into a min-heap of up to LD_WINDOW
+ * entries ordered by start time, so memory stays bounded however long
+ * the configuration is. Lines may be out of order by up to LD_WINDOW
+ * positions; an arrival found later than that is admitted late. */
+#define LD_WINDOW	4096
+
+static struct {
+	FILE * file;
+	int left;		/* Arrival lines not read yet */
+	unsigned long seq;
+	struct ld_arrival_t * heap;
+	int size;
+} ld_stream;
+
+/* Loader pool: host threads read the next LD_AHEAD programs ahead of
+ * their start time, the loader then only attaches the ready PCBs when
+ * their time comes. */
+#define LD_AHEAD	64
+
+static struct {
+	pthread_t * threads;
+	int nr_threads;
+	struct ld_arrival_t ring[LD_AHEAD];	/* Arrivals by start time */
+	unsigned long head;		/* Next arrival to attach */
+	unsigned long claim;		/* Next arrival to read */
+	unsigned long fill;		/* Next free entry */
+	int exhausted;			/* Every arrival is in the ring */
+	pthread_mutex_t lock;
+	pthread_cond_t loaded;		/* An arrival was added or read */
+	pthread_cond_t space;		/* An arrival was attached */
+	uint64_t read_ns;		/* Host time spent reading, all threads */
+	uint64_t wait_ns;		/* Host time the loader waited on it */
+} ld_pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.loaded = PTHREAD_COND_INITIALIZER,
+	.space = PTHREAD_COND_INITIALIZER,
+};
 
 struct cpu_args {
 	struct timer_id_t * timer_id;
 	int id;
+	/* Execution state carried from one time slot to the next */
+	struct pcb_t * proc;
+	int time_left;
+	unsigned long nr_ins;	/* Instructions the CPU has executed */
 };
 
+/* Outcome of the work a device did in one time slot */
+enum slot_status {
+	SLOT_BUSY,	/* Did real work in the slot */
+	SLOT_IDLE,	/* Nothing to do before some wakeup time */
+	SLOT_STOPPED,	/* Device has finished for good */
+};
+
+/* Execution engines */
+enum engine_t {
+	ENGINE_THREADED,	/* One host thread per CPU and loader */
+	ENGINE_DES,		/* Every device driven from a single event loop */
+	ENGINE_POOL,		/* CPUs multiplexed onto a pool of host workers */
+};
+
+static enum engine_t engine = ENGINE_THREADED;
+static const char * engine_names[] = { "threaded", "des", "pool" };
+static unsigned int engine_seed = 0;
+static int num_workers = 0;
+
+/* Skip the rest of the current slot with nothing to do before [wakeup] */
+static void idle_slot(struct timer_id_t * timer_id, uint64_t wakeup) {
+#ifdef IDLE_SKIP
+	next_slot_idle(timer_id, wakeup);
+#else
+	next_slot(timer_id);
+#endif
+}
+
+/* cpu_step - do the work of one CPU in the current time slot */
+static enum slot_status cpu_step(struct cpu_args * cpu) {
+	int id = cpu->id;
+	struct pcb_t * proc = cpu->proc;
+
+	/* Check the status of current process */
+	if (proc == NULL) {
+		/* No process is running, the we load new process from
+		 * ready queue */
+		proc = get_proc(id);
+	}else if (proc->pc == proc->code->size) {
+		/* The porcess has finish it job */
+		evlog(EV_FINISH, id, proc->pid, 0, NULL);
+		finish_proc(id, proc);
+		free_proc(proc);
+		proc = get_proc(id);
+		cpu->time_left = 0;
+	}else if (cpu->time_left == 0) {
+		/* The process has done its job in current time slot */
+		evlog(EV_PUT, id, proc->pid, 0, NULL);
+		put_proc(id, proc);
+		proc = get_proc(id);
+	}
+	cpu->proc = proc;
+
+	/* Recheck process status after loading new process */
+	if (proc == NULL && done) {
+		/* No process to run, exit */
+		evlog(EV_CPU_STOP, id, 0, 0, NULL);
+		return SLOT_STOPPED;
+	}else if (proc == NULL) {
+		/* There may be new processes to run in
+		 * next time slots, just skip current slot */
+		return SLOT_IDLE;
+	}else if (cpu->time_left == 0) {
+		evlog(EV_DISPATCH, id, proc->pid, 0, NULL);
+		cpu->time_left = time_slot;
+	}
+
+	/* Run current process, once it has sat out the swap device time
+	 * it owes. Waiting takes the place of instructions in the slot */
+	int count = ins_per_slot;
+#ifdef MM_PAGING
+	if (proc->io_wait >= 1000) {
+		uint64_t wait = proc->io_wait / 1000;
+		if (wait > (uint64_t)count) wait = count;
+		proc->io_wait -= wait * 1000;
+		count -= wait;
+	}
+#endif
+	cpu->nr_ins += run_slice(proc, count);
+	proc->run_slots++;
+	cpu->time_left--;
+	return SLOT_BUSY;
+}
 
 static void * cpu_routine(void * args) {
-	struct timer_id_t * timer_id = ((struct cpu_args*)args)->timer_id;
-	int id = ((struct cpu_args*)args)->id;
-	/* Check for new process in ready queue */
-	int time_left = 0;
-	struct pcb_t * proc = NULL;
+	struct cpu_args * cpu = (struct cpu_args*)args;
 	while (1) {
-		/* Check the status of current process */
-		if (proc == NULL) {
-			/* No process is running, the we load new process from
-	  		* ready queue */
-			proc = get_proc();
-			if (proc == NULL) {
-                           next_slot(timer_id);
-                           continue; /* First load failed. skip dummy load */
-                        }
-		}else if (proc->pc == proc->code->size) {
-			/* The porcess has finish it job */
-			printf("\tCPU %d: Processed %2d has finished\n",
-				id ,proc->pid);
-			free(proc);
-			proc = get_proc();
-			time_left = 0;
-		}else if (time_left == 0) {
-			/* The process has done its job in current time slot */
-			printf("\tCPU %d: Put process %2d to run queue\n",
-				id, proc->pid);
-			put_proc(proc);
-			proc = get_proc();
-		}
-		
-		/* Recheck process status after loading new process */
-		if (proc == NULL && done) {
-			/* No process to run, exit */
-			printf("\tCPU %d stopped\n", id);
+		enum slot_status status = cpu_step(cpu);
+		if (status == SLOT_STOPPED) {
 			break;
-		}else if (proc == NULL) {
-			/* There may be new processes to run in
-			 * next time slots, just skip current slot */
-			next_slot(timer_id);
-			continue;
-		}else if (time_left == 0) {
-			printf("\tCPU %d: Dispatched process %2d\n",
-				id, proc->pid);
-			time_left = time_slot;
-		}
-		
-		/* Run current process */
-		run(proc);
-		time_left--;
-		next_slot(timer_id);
+		}else if (status == SLOT_IDLE) {
+			idle_slot(cpu->timer_id, TIMER_NO_WAKEUP);
+		}else{
+			next_slot(cpu->timer_id);
+		}
 	}
-	detach_event(timer_id);
+	detach_event(cpu->timer_id);
 	pthread_exit(NULL);
 }
 
-static void * ld_routine(void * args) {
+static uint64_t host_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int arrival_before(const struct ld_arrival_t * a, const struct ld_arrival_t * b) {
+	return a->start_time < b->start_time ||
+		(a->start_time == b->start_time && a->seq < b->seq);
+}
+
+static void ld_stream_push(struct ld_arrival_t * a) {
+	struct ld_arrival_t * heap = ld_stream.heap;
+	int i = ld_stream.size++;
+	while (i > 0 && arrival_before(a, &heap[(i - 1) / 2])) {
+		heap[i] = heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	heap[i] = *a;
+}
+
+static void ld_stream_pop(struct ld_arrival_t * a) {
+	struct ld_arrival_t * heap = ld_stream.heap;
+	*a = heap[0];
+	struct ld_arrival_t last = heap[--ld_stream.size];
+	int i = 0;
+	while (2 * i + 1 < ld_stream.size) {
+		int c = 2 * i + 1;
+		if (c + 1 < ld_stream.size && arrival_before(&heap[c + 1], &heap[c])) c++;
+		if (!arrival_before(&heap[c], &last)) break;
+		heap[i] = heap[c];
+		i = c;
+	}
+	heap[i] = last;
+}
+
+/* Get the next arrival by start time, 0 once there is none left */
+static int ld_stream_next(struct ld_arrival_t * a) {
+	char * line = NULL;
+	size_t cap = 0;
+	while (ld_stream.size < LD_WINDOW && ld_stream.left > 0) {
+		if (getline(&line, &cap, ld_stream.file) < 0) {
+			ld_stream.left = 0;
+			break;
+		}
+		ld_stream.left--;
+
+		/* <start time> <program> [priority] */
+		struct ld_arrival_t arrival;
+		char * p = line;
+		arrival.start_time = strtoul(p, &p, 10);
+		while (*p == ' ' || *p == '\t') p++;
+		char * name = p;
+		while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++;
+		arrival.path = resolve_path("input/proc/", name, p - name);
+		arrival.prio = strtoul(p, NULL, 10);
+		arrival.seq = ld_stream.seq++;
+		arrival.proc = NULL;
+		ld_stream_push(&arrival);
+	}
+	free(line);
+	if (ld_stream.left == 0 && ld_stream.file != NULL) {
+		fclose(ld_stream.file);
+		ld_stream.file = NULL;
+	}
+	if (ld_stream.size == 0) {
+		return 0;
+	}
+	ld_stream_pop(a);
+	return 1;
+}
+
+static void * ld_pool_worker(void * args) {
+	pthread_mutex_lock(&ld_pool.lock);
+	while (1) {
+		/* Every arrival in the ring is taken and there is no room */
+		while (ld_pool.claim == ld_pool.fill &&
+		       ld_pool.fill - ld_pool.head == LD_AHEAD) {
+			pthread_cond_wait(&ld_pool.space, &ld_pool.lock);
+		}
+		if (ld_pool.claim == ld_pool.fill) {
+			if (ld_pool.exhausted ||
+			    !ld_stream_next(&ld_pool.ring[ld_pool.fill % LD_AHEAD])) {
+				ld_pool.exhausted = 1;
+				pthread_cond_broadcast(&ld_pool.loaded);
+				break;
+			}
+			ld_pool.fill++;
+			pthread_cond_broadcast(&ld_pool.loaded);
+		}
+		struct ld_arrival_t * a = &ld_pool.ring[ld_pool.claim % LD_AHEAD];
+		ld_pool.claim++;
+		pthread_mutex_unlock(&ld_pool.lock);
+		uint64_t start = host_ns();
+		struct pcb_t * proc = load_proc(a->path);
+		uint64_t end = host_ns();
+		pthread_mutex_lock(&ld_pool.lock);
+		a->proc = proc;
+		ld_pool.read_ns += end - start;
+		pthread_cond_broadcast(&ld_pool.loaded);
+	}
+	pthread_mutex_unlock(&ld_pool.lock);
+	return args;
+}
+
+/* Start reading programs ahead with up to [nr_threads] threads */
+static void ld_pool_start(int nr_threads) {
+	if (nr_threads > num_processes) nr_threads = num_processes;
+	if (nr_threads > LD_AHEAD) nr_threads = LD_AHEAD;
+	ld_pool.nr_threads = nr_threads;
+	ld_pool.threads = (pthread_t*)malloc(sizeof(pthread_t) * (nr_threads + 1));
+	ld_pool.exhausted = (nr_threads == 0);
+	for (int i = 0; i < nr_threads; i++) {
+		pthread_create(&ld_pool.threads[i], NULL, ld_pool_worker, NULL);
+	}
+}
+
+/* Wait on the loader pool, counting the time it costs */
+static void ld_pool_wait(void) {
+	uint64_t start = host_ns();
+	pthread_cond_wait(&ld_pool.loaded, &ld_pool.lock);
+	ld_pool.wait_ns += host_ns() - start;
+}
+
+static void ld_pool_stop(void) {
+	for (int i = 0; i < ld_pool.nr_threads; i++) {
+		pthread_join(ld_pool.threads[i], NULL);
+	}
+	free(ld_pool.threads);
+	ld_pool.threads = NULL;
+	free(ld_stream.heap);
+	ld_stream.heap = NULL;
+}
+
+/* Give [proc] its PID and memory and hand it to the scheduler */
+static void ld_attach(void * args, struct pcb_t * proc, unsigned long prio,
+		const char * path) {
 #ifdef MM_PAGING
 	struct memphy_struct* mram = ((struct mmpaging_ld_args *)args)->mram;
 	struct memphy_struct** mswp = ((struct mmpaging_ld_args *)args)->mswp;
 	struct memphy_struct* active_mswp = ((struct mmpaging_ld_args *)args)->active_mswp;
-	struct timer_id_t * timer_id = ((struct mmpaging_ld_args *)args)->timer_id;
-#else
-	struct timer_id_t * timer_id = (struct timer_id_t*)args;
 #endif
-	int i = 0;
-	printf("ld_routine\n");
-	while (i < num_processes) {
-		struct pcb_t * proc = load(ld_processes.path[i]);
+	attach_pid(proc);
 #ifdef MLQ_SCHED
-		proc->prio = ld_processes.prio[i];
+	proc->prio = prio;
 #endif
-		while (current_time() < ld_processes.start_time[i]) {
-			next_slot(timer_id);
+#ifdef MM_PAGING
+	proc->mm = arena_calloc(proc->arena, sizeof(struct mm_struct));
+	init_mm(proc->mm, proc);
+	proc->mram = mram;
+	proc->mswp = mswp;
+	proc->active_mswp = active_mswp;
+	proc->io_wait = 0;
+#endif
+	evlog(EV_LOAD, proc->pid, prio, 0, path);
+	add_proc(proc);
+	nr_loaded++;
+}
+
+/* ld_step - admit the next process if its start time has come.
+ * On SLOT_IDLE, [wakeup] holds the time the loader wants to run again */
+static enum slot_status ld_step(void * args, uint64_t * wakeup) {
+	/* Processes submitted on the control channel come in at once */
+	int admitted = 0;
+	char * path;
+	unsigned long prio;
+	while (ctl_take(&path, &prio)) {
+		ld_attach(args, load_proc(path), prio, path);
+		free(path);
+		admitted = 1;
+	}
+
+	pthread_mutex_lock(&ld_pool.lock);
+	while (ld_pool.head == ld_pool.fill && !ld_pool.exhausted) {
+		ld_pool_wait();
+	}
+	if (ld_pool.head == ld_pool.fill) {
+		pthread_mutex_unlock(&ld_pool.lock);
+		if (ctl_enabled() && !ctl_shutdown()) {
+			/* Keep serving. With nothing left to run the clock
+			 * waits for the next client request. */
+			if (!admitted && live_procs() == 0) {
+				ctl_wait();
+			}
+			*wakeup = current_time() + 1;
+			return admitted ? SLOT_BUSY : SLOT_IDLE;
+		}
+		if (admitted) {
+			return SLOT_BUSY;
 		}
+		ld_pool_stop();
+		done = 1;
+		return SLOT_STOPPED;
+	}
+	struct ld_arrival_t * a = &ld_pool.ring[ld_pool.head % LD_AHEAD];
+	if (current_time() < a->start_time) {
+		*wakeup = a->start_time;
+		pthread_mutex_unlock(&ld_pool.lock);
+		return admitted ? SLOT_BUSY : SLOT_IDLE;
+	}
+	while (a->proc == NULL) {
+		ld_pool_wait();
+	}
+	struct ld_arrival_t arrival = *a;
+	ld_pool.head++;
+	pthread_cond_broadcast(&ld_pool.space);
+	pthread_mutex_unlock(&ld_pool.lock);
+
+	ld_attach(args, arrival.proc, arrival.prio, arrival.path);
+	free(arrival.path);
+	return SLOT_BUSY;
+}
+
+static void * ld_routine(void * args) {
 #ifdef MM_PAGING
-		proc->mm = malloc(sizeof(struct mm_struct));
-		init_mm(proc->mm, proc);
-		proc->mram = mram;
-		proc->mswp = mswp;
-		proc->active_mswp = active_mswp;
+	struct timer_id_t * timer_id = ((struct mmpaging_ld_args *)args)->timer_id;
+#else
+	struct timer_id_t * timer_id = (struct timer_id_t*)args;
 #endif
-		printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
-			ld_processes.path[i], proc->pid, ld_processes.prio[i]);
-		add_proc(proc);
-		free(ld_processes.path[i]);
-		i++;
-		next_slot(timer_id);
-	}
-	free(ld_processes.path);
-	free(ld_processes.start_time);
-	done = 1;
+	evlog(EV_LD_START, 0, 0, 0, NULL);
+	while (1) {
+		uint64_t wakeup;
+		enum slot_status status = ld_step(args, &wakeup);
+		if (status == SLOT_STOPPED) {
+			break;
+		}else if (status == SLOT_IDLE) {
+			idle_slot(timer_id, wakeup);
+		}else{
+			next_slot(timer_id);
+		}
+	}
 	detach_event(timer_id);
 	pthread_exit(NULL);
 }
 
+/* Worker pool of the ENGINE_POOL engine. Every time slot the event
+ * loop opens [slot_start], the workers (and the event loop itself)
+ * grab CPUs off [next_cpu] until none is left, then meet again on
+ * [slot_end] before the loader and the clock move on. */
+static struct cpu_pool_t {
+	pthread_t * workers;
+	int nr_workers;		/* Host threads, the event loop included */
+	pthread_barrier_t slot_start;
+	pthread_barrier_t slot_end;
+	atomic_int next_cpu;
+	int quit;
+	struct cpu_args * cpus;
+	int * order;
+	enum slot_status * status;
+} pool;
+
+/* Run the CPUs of the current slot that are still left to grab */
+static void pool_run_cpus(void) {
+	int i;
+	while ((i = atomic_fetch_add(&pool.next_cpu, 1)) < num_cpus) {
+		int id = pool.order[i];
+		if (pool.status[id] != SLOT_STOPPED) {
+			pool.status[id] = cpu_step(&pool.cpus[id]);
+		}
+	}
+}
+
+static void * pool_worker(void * args) {
+	while (1) {
+		pthread_barrier_wait(&pool.slot_start);
+		if (pool.quit) break;
+		pool_run_cpus();
+		pthread_barrier_wait(&pool.slot_end);
+	}
+	pthread_exit(args);
+}
+
+static void pool_init(int nr_workers, struct cpu_args * cpus,
+		int * order, enum slot_status * status) {
+	pool.nr_workers = (nr_workers < 1) ? 1 : nr_workers;
+	if (pool.nr_workers > num_cpus) pool.nr_workers = num_cpus;
+	pool.cpus = cpus;
+	pool.order = order;
+	pool.status = status;
+	pool.quit = 0;
+	pthread_barrier_init(&pool.slot_start, NULL, pool.nr_workers);
+	pthread_barrier_init(&pool.slot_end, NULL, pool.nr_workers);
+	pool.workers = (pthread_t*)malloc(sizeof(pthread_t) * pool.nr_workers);
+	for (int i = 1; i < pool.nr_workers; i++) {
+		pthread_create(&pool.workers[i], NULL, pool_worker, NULL);
+	}
+}
+
+static void pool_destroy(void) {
+	pool.quit = 1;
+	pthread_barrier_wait(&pool.slot_start);
+	for (int i = 1; i < pool.nr_workers; i++) {
+		pthread_join(pool.workers[i], NULL);
+	}
+	pthread_barrier_destroy(&pool.slot_start);
+	pthread_barrier_destroy(&pool.slot_end);
+	free(pool.workers);
+}
+
+/* Do the CPU steps of one slot, spread over the pool if there is one */
+static void run_cpus(void) {
+	atomic_store(&pool.next_cpu, 0);
+	if (pool.nr_workers <= 1) {
+		pool_run_cpus();
+		return;
+	}
+	pthread_barrier_wait(&pool.slot_start);
+	pool_run_cpus();
+	pthread_barrier_wait(&pool.slot_end);
+}
+
+/* des_engine - drive every CPU and the loader from the calling thread.
+ * In each time slot the CPUs run first, in id order or in an order
+ * shuffled by [engine_seed], then the loader admits the next arrival.
+ * When nobody has work the clock jumps to the next arrival.
+ * With [nr_workers] > 1 the CPU steps of a slot are run in parallel
+ * by a pool of host threads and joined at the slot boundary. */
+static void des_engine(struct cpu_args * cpus, void * ld_args, int nr_workers) {
+	int * order = (int*)malloc(sizeof(int) * num_cpus);
+	enum slot_status * status =
+		(enum slot_status*)malloc(sizeof(enum slot_status) * num_cpus);
+	int running = num_cpus;
+	int ld_running = 1;
+	unsigned int rnd = engine_seed;
+
+	for (int i = 0; i < num_cpus; i++) {
+		order[i] = i;
+		status[i] = SLOT_IDLE;
+	}
+	pool_init(nr_workers, cpus, order, status);
+
+	start_manual_timer();
+	evlog(EV_LD_START, 0, 0, 0, NULL);
+	while (running > 0 || ld_running) {
+		int busy = 0;
+		uint64_t wakeup = TIMER_NO_WAKEUP;
+
+		if (engine_seed != 0) {
+			/* Fisher-Yates with a xorshift generator */
+			for (int i = num_cpus - 1; i > 0; i--) {
+				rnd ^= rnd << 13;
+				rnd ^= rnd >> 17;
+				rnd ^= rnd << 5;
+				int j = rnd % (i + 1);
+				int tmp = order[i];
+				order[i] = order[j];
+				order[j] = tmp;
+			}
+		}
+
+		run_cpus();
+		running = 0;
+		for (int i = 0; i < num_cpus; i++) {
+			if (status[i] != SLOT_STOPPED) running++;
+			if (status[i] == SLOT_BUSY) busy = 1;
+		}
+
+		if (ld_running) {
+			uint64_t ld_wakeup;
+			enum slot_status st = ld_step(ld_args, &ld_wakeup);
+			if (st == SLOT_STOPPED) {
+				ld_running = 0;
+			}else if (st == SLOT_BUSY) {
+				busy = 1;
+			}else{
+				wakeup = ld_wakeup;
+			}
+		}
+
+		uint64_t next = current_time() + 1;
+#ifdef IDLE_SKIP
+		if (!busy && wakeup != TIMER_NO_WAKEUP && wakeup > next) {
+			next = wakeup;
+		}
+#endif
+		if (running > 0 || ld_running) {
+			step_timer(next);
+		}
+	}
+	pool_destroy();
+	free(order);
+	free(status);
+}
+
+/* Parse the memory line, "<ram> <swap 0> .. <swap 3>". A swap written
+ * <size>@<file> lives in that host file, <size>@<file>,direct bypasses
+ * the host page cache. Returns -1 if [line] is not a memory line */
+static int parse_memsz(char * line) {
+	int size[1 + PAGING_MAX_MMSWP];
+	char * file[1 + PAGING_MAX_MMSWP];
+	int n = 0;
+	for (char * tok = strtok(line, " \t\r\n"); tok != NULL; tok = strtok(NULL, " \t\r\n")) {
+		char * end;
+		if (n == 1 + PAGING_MAX_MMSWP) return -1;
+		size[n] = strtol(tok, &end, 10);
+		file[n] = NULL;
+		if (end == tok || (*end != '\0' && (*end != '@' || n == 0 || end[1] == '\0'))) {
+			return -1;
+		}
+		if (*end == '@') file[n] = end + 1;
+		n++;
+	}
+	if (n != 1 + PAGING_MAX_MMSWP) return -1;
+#ifdef MM_PAGING
+	memramsz = size[0];
+	for (int i = 0; i < PAGING_MAX_MMSWP; i++) {
+		memswpsz[i] = size[i + 1];
+		memswpfile[i] = NULL;
+		memswpdirect[i] = 0;
+		if (file[i + 1] == NULL) continue;
+		char * opt = strrchr(file[i + 1], ',');
+		if (opt != NULL && !strcmp(opt, ",direct")) {
+			*opt = '\0';
+			memswpdirect[i] = 1;
+		}
+		memswpfile[i] = strdup(file[i + 1]);
+	}
+#endif
+	return 0;
+}
+
 static void read_config(const char * path) {
 	FILE * file;
 	if ((file = fopen(path, "r")) == NULL) {
@@ -146,69 +625,198 @@ static void read_config(const char * path) {
 		exit(1);
 	}
 
-	char line[128];
+	char line[1024];
+	char policy[16];
 	fgets(line, sizeof(line), file);
-	sscanf(line, "%d %d %d", &time_slot, &num_cpus, &num_processes);
-
-	ld_processes.path = (char**)malloc(sizeof(char*) * num_processes);
-	ld_processes.start_time = (unsigned long*) malloc(sizeof(unsigned long) * num_processes);
-#ifdef MLQ_SCHED
-	ld_processes.prio = (unsigned long*) malloc(sizeof(unsigned long) * num_processes);
-#endif
+	/* An optional fourth field names the scheduling policy */
+	if (sscanf(line, "%d %d %d %15s", &time_slot, &num_cpus, &num_processes, policy) == 4) {
+		int p = sched_policy_from_name(policy);
+		if (p < 0) {
+			printf("Unknown scheduling policy '%s' in %s\n", policy, path);
+			exit(1);
+		}
+		sched_policy = p;
+	}
 
 	long cursor = ftell(file);
-	int temp[5];
-	if (fgets(line, sizeof(line), file) && sscanf(line, "%d %d %d %d %d", &temp[0], &temp[1], &temp[2], &temp[3], &temp[4]) == 5) {
-#ifdef MM_PAGING
-		memramsz = temp[0];
-		for (int i = 0; i < PAGING_MAX_MMSWP; i++) memswpsz[i] = temp[i+1];
-#endif
-	} else {
+	if (!fgets(line, sizeof(line), file) || parse_memsz(line) != 0) {
 		fseek(file, cursor, SEEK_SET);
 	}
 
-	for (int i = 0; i < num_processes; i++) {
-		char proc[100];
-		ld_processes.path[i] = (char*)malloc(100);
-		ld_processes.path[i][0] = '\0';
-		strcat(ld_processes.path[i], "input/proc/");
-		fgets(line, sizeof(line), file);
-#ifdef MLQ_SCHED
-		sscanf(line, "%lu %s %lu", &ld_processes.start_time[i], proc, &ld_processes.prio[i]);
+	/* Arrivals are read as the loader gets to them */
+	ld_stream.file = file;
+	ld_stream.left = num_processes;
+	ld_stream.heap = (struct ld_arrival_t*)malloc(sizeof(struct ld_arrival_t) * LD_WINDOW);
+}
+
+static void report_load(uint64_t sim_ns) {
+#ifdef LOAD_STATS
+	fprintf(stderr, "load: %lu programs read in %.3f ms by %d loader threads\n",
+		nr_loaded, ld_pool.read_ns / 1e6, ld_pool.nr_threads);
+	fprintf(stderr, "simulation: %.3f ms, %.3f ms of it waiting for programs\n",
+		sim_ns / 1e6, ld_pool.wait_ns / 1e6);
+#endif
+}
+
+/* Append the figures of the run to [stats_path] as one JSON object */
+static const char * stats_path = NULL;
+static struct memphy_struct * stats_mram = NULL;	/* Frames left over at the end */
+static struct memphy_struct * stats_mswp = NULL;	/* Swap cursor travel and transfers */
+
+static void write_stats(const char * config, struct cpu_args * cpus,
+		int nr_workers, uint64_t sim_ns) {
+	if (stats_path == NULL) return;
+	FILE * file;
+	if ((file = fopen(stats_path, "a")) == NULL) {
+		fprintf(stderr, "Cannot write statistics to %s\n", stats_path);
+		return;
+	}
+	unsigned long nr_ins = 0;
+	for (int i = 0; i < num_cpus; i++) {
+		nr_ins += cpus[i].nr_ins;
+	}
+#ifdef MM_PAGING
+	unsigned long nr_faults = mm_page_faults();
 #else
-		sscanf(line, "%lu %s", &ld_processes.start_time[i], proc);
+	unsigned long nr_faults = 0;
 #endif
-		strcat(ld_processes.path[i], proc);
+	int nr_frames = 0, nr_free_frames = 0;
+	if (stats_mram != NULL) {
+		nr_frames = stats_mram->maxsz / PAGING_PAGESZ;
+		nr_free_frames = stats_mram->nr_free_fp;
+	}
+	unsigned long seek_bytes = 0, xfer_bytes = 0, swap_io_ops = 0;
+	if (stats_mswp != NULL) {
+		seek_bytes = stats_mswp->seek_bytes;
+		xfer_bytes = stats_mswp->xfer_bytes;
+		swap_io_ops = stats_mswp->io_ops;
 	}
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	double sec = (sim_ns > 0) ? sim_ns / 1e9 : 1e-9;
+	unsigned long slots = current_time();
+
+	fprintf(file, "{\"config\": \"");
+	for (const char * c = config; *c; c++) {
+		if (*c == '"' || *c == '\\') fputc('\\', file);
+		fputc(*c, file);
+	}
+	fprintf(file, "\", \"engine\": \"%s\", \"cpus\": %d, \"workers\": %d,"
+		" \"ins_per_slot\": %d, \"processes\": %lu, \"slots\": %lu,"
+		" \"wall_ms\": %.3f, \"load_ms\": %.3f, \"slots_per_sec\": %.1f,"
+		" \"instructions\": %lu, \"ins_per_sec\": %.1f,"
+		" \"page_faults\": %lu, \"frames\": %d, \"free_frames\": %d,"
+		" \"swap_seek_bytes\": %lu, \"swap_xfer_bytes\": %lu, \"swap_io_ops\": %lu,"
+		" \"peak_rss_kb\": %ld}\n",
+		engine_names[engine], num_cpus, nr_workers, ins_per_slot,
+		nr_loaded, slots, sim_ns / 1e6,
+		ld_pool.read_ns / 1e6, slots / sec,
+		nr_ins, nr_ins / sec, nr_faults, nr_frames, nr_free_frames,
+		seek_bytes, xfer_bytes, swap_io_ops, ru.ru_maxrss);
 	fclose(file);
 }
 
+static void usage(void) {
+	printf("Usage: os [-e threaded|des|pool] [-w workers] [-r seed] [-l event log]"
+		" [-i instructions per slot] [-c control socket] [-j statistics file]"
+		" [path to configure file]\n");
+}
+
 int main(int argc, char * argv[]) {
-	if (argc != 2) {
-		printf("Usage: os [path to configure file]\n");
+	int opt;
+	const char * ctl_path = NULL;
+	while ((opt = getopt(argc, argv, "e:r:w:l:i:c:j:")) != -1) {
+		switch (opt) {
+		case 'e':
+			if (!strcmp(optarg, "threaded")) {
+				engine = ENGINE_THREADED;
+			}else if (!strcmp(optarg, "des")) {
+				engine = ENGINE_DES;
+			}else if (!strcmp(optarg, "pool")) {
+				engine = ENGINE_POOL;
+			}else{
+				usage();
+				return 1;
+			}
+			break;
+		case 'w':
+			num_workers = atoi(optarg);
+			break;
+		case 'i':
+			ins_per_slot = atoi(optarg);
+			if (ins_per_slot < 1) {
+				usage();
+				return 1;
+			}
+			break;
+		case 'l':
+			/* Trace goes to a binary log, see tools/evdecode */
+			if (evlog_open(optarg) != 0) {
+				printf("Cannot open event log at %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'c':
+			/* Accept processes and queries at runtime, see ctl.h */
+			ctl_path = optarg;
+			break;
+		case 'j':
+			/* Machine-readable run statistics, see bench/suite.sh */
+			stats_path = optarg;
+			break;
+		case 'r':
+			engine_seed = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (optind != argc - 1) {
+		usage();
 		return 1;
 	}
 
-	char path[100] = "input/";
-	strcat(path, argv[1]);
+	char * path = resolve_path("input/", argv[optind], strlen(argv[optind]));
 	read_config(path);
+	free(path);
+	ld_pool_start((int)sysconf(_SC_NPROCESSORS_ONLN));
+	uint64_t sim_start = host_ns();
 
 	pthread_t * cpu = (pthread_t*)malloc(num_cpus * sizeof(pthread_t));
 	struct cpu_args * args = (struct cpu_args*)malloc(sizeof(struct cpu_args) * num_cpus);
 	pthread_t ld;
 
 	for (int i = 0; i < num_cpus; i++) {
-		args[i].timer_id = attach_event();
+		args[i].timer_id = NULL;
 		args[i].id = i;
+		args[i].proc = NULL;
+		args[i].time_left = 0;
+		args[i].nr_ins = 0;
+	}
+	struct timer_id_t * ld_event = NULL;
+	if (engine == ENGINE_THREADED) {
+		for (int i = 0; i < num_cpus; i++) {
+			args[i].timer_id = attach_event();
+		}
+		ld_event = attach_event();
+		start_timer();
 	}
-	struct timer_id_t * ld_event = attach_event();
-	start_timer();
 
 #ifdef MM_PAGING
 	struct memphy_struct mram;
 	struct memphy_struct mswp[PAGING_MAX_MMSWP];
 	init_memphy(&mram, memramsz, 1);
-	for (int i = 0; i < PAGING_MAX_MMSWP; i++) init_memphy(&mswp[i], memswpsz[i], 1);
+	for (int i = 0; i < PAGING_MAX_MMSWP; i++) {
+		if (memswpfile[i] == NULL) {
+			init_memphy(&mswp[i], memswpsz[i], !MEMSWP_SEQ);
+		}else if (init_memphy_file(&mswp[i], memswpsz[i], !MEMSWP_SEQ,
+				memswpfile[i], memswpdirect[i]) != 0) {
+			printf("Cannot open swap %d at %s\n", i, memswpfile[i]);
+			return 1;
+		}
+		MEMPHY_set_cost(&mswp[i], MEMSWP_SEEK_COST, MEMSWP_XFER_COST);
+	}
 
 	struct mmpaging_ld_args *mm_ld_args = malloc(sizeof(struct mmpaging_ld_args));
 	mm_ld_args->timer_id = ld_event;
@@ -216,12 +824,48 @@ int main(int argc, char * argv[]) {
 	mm_ld_args->mswp = (struct memphy_struct **) &mswp;
 	mm_ld_args->active_mswp = &mswp[0];
 	mm_ld_args->active_mswp_id = 0;
-	pthread_create(&ld, NULL, ld_routine, (void*)mm_ld_args);
+	void * ld_args = (void*)mm_ld_args;
+	stats_mram = &mram;
+	stats_mswp = &mswp[0];
+#else
+	void * ld_args = (void*)ld_event;
+#endif
+
+	if (ctl_path != NULL) {
+#ifdef MM_PAGING
+		struct memphy_struct * ctl_mram = &mram;
 #else
-	pthread_create(&ld, NULL, ld_routine, (void*)ld_event);
+		struct memphy_struct * ctl_mram = NULL;
 #endif
+		if (ctl_open(ctl_path, num_cpus, ctl_mram) != 0) {
+			printf("Cannot open control socket at %s\n", ctl_path);
+			return 1;
+		}
+	}
+
+	if (engine == ENGINE_DES || engine == ENGINE_POOL) {
+		int nr_workers = 1;
+		if (engine == ENGINE_POOL) {
+			/* Default to one worker per host core */
+			nr_workers = (num_workers > 0) ? num_workers
+				: (int)sysconf(_SC_NPROCESSORS_ONLN);
+		}
+		init_scheduler(num_cpus, sched_policy);
+		des_engine(args, ld_args, nr_workers);
+		finish_scheduler();
+		uint64_t sim_ns = host_ns() - sim_start;
+		report_load(sim_ns);
+		write_stats(argv[optind], args, nr_workers, sim_ns);
+		ctl_close();
+		flush_code_cache();
+		evlog_close();
+		return 0;
+	}
+
+	/* The loader may add processes from its very first slot */
+	init_scheduler(num_cpus, sched_policy);
+	pthread_create(&ld, NULL, ld_routine, ld_args);
 
-	init_scheduler();
 	for (int i = 0; i < num_cpus; i++) {
 		pthread_create(&cpu[i], NULL, cpu_routine, (void*)&args[i]);
 	}
@@ -232,5 +876,12 @@ int main(int argc, char * argv[]) {
 	pthread_join(ld, NULL);
 
 	stop_timer();
+	finish_scheduler();
+	uint64_t sim_ns = host_ns() - sim_start;
+	report_load(sim_ns);
+	write_stats(argv[optind], args, num_cpus, sim_ns);
+	ctl_close();
+	flush_code_cache();
+	evlog_close();
 	return 0;
 }
\ No newline at end of file
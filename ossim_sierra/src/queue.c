@@ -2,70 +2,84 @@
 #include <stdlib.h>
 #include "queue.h"
 
+void queue_init(struct queue_t * q, struct pcb_t ** storage, int capacity) {
+        q->proc = storage;
+        q->head = 0;
+        q->size = 0;
+        q->capacity = (storage == NULL) ? 0 : capacity;
+        q->owned = 0;
+}
+
+void queue_free(struct queue_t * q) {
+        if (q == NULL) return;
+        if (q->owned) free(q->proc);
+        q->proc = NULL;
+        q->head = q->size = q->capacity = q->owned = 0;
+}
+
+/* Double the storage of [q], unwrapping the ring to start at index 0 */
+static void queue_grow(struct queue_t * q) {
+        int capacity = (q->capacity == 0) ? QUEUE_INIT_CAP : q->capacity * 2;
+        struct pcb_t ** proc = malloc(capacity * sizeof(struct pcb_t *));
+        if (proc == NULL) {
+                fprintf(stderr, "Queue cannot grow past %d processes\n", q->capacity);
+                exit(1);
+        }
+        for (int i = 0; i < q->size; i++) {
+                proc[i] = q->proc[(q->head + i) % q->capacity];
+        }
+        if (q->owned) free(q->proc);
+        q->proc = proc;
+        q->head = 0;
+        q->capacity = capacity;
+        q->owned = 1;
+}
+
 int empty(struct queue_t * q) {
         if (q == NULL) return 1;
 	return (q->size == 0);
 }
 
 void enqueue(struct queue_t * q, struct pcb_t * proc) {
-        /* TODO: put a new process to queue [q] */
+        /* Put a new process at the tail of queue [q] */
         if (q == NULL || proc == NULL) return;
-        if (q->size >= MAX_QUEUE_SIZE) {
-                fprintf(stderr, "Queue is full, cannot enqueue process %d\n", proc->pid);
-                return;
+        if (q->size == q->capacity) {
+                queue_grow(q);
         }
-
-        // Safety check for size bounds
-        if (q->size < 0)
-                q->size = 0;
-
-        // Add the process to the end of the queue
-        q->proc[q->size] = proc;
+        int tail = q->head + q->size;
+        if (tail >= q->capacity) tail -= q->capacity;
+        q->proc[tail] = proc;
         q->size++;
 }
 
 struct pcb_t * dequeue(struct queue_t * q) {
-        /* TODO: return a pcb whose prioprity is the highest
-         * in the queue [q] and remember to remove it from q
-         * */
+        /* Take the oldest process out of queue [q]. Every level of the
+         * MLQ holds a single priority, so FIFO order is priority order */
         if (q == NULL || q->size <= 0) return NULL;
-        
-        // Validate the queue size
-        if (q->size > MAX_QUEUE_SIZE) {
-                q->size = MAX_QUEUE_SIZE;
-        }
-        
-        // Find the process with highest priority (lowest number)
-        int highest_priority_idx = 0;
-        for (int i = 1; i < q->size; i++) {
-                if (q->proc[i] == NULL || q->proc[highest_priority_idx] == NULL) {
-                        continue; // Skip null entries for safety
-                }
-#ifdef MLQ_SCHED
-                if (q->proc[i]->prio < q->proc[highest_priority_idx]->prio) {
-                        highest_priority_idx = i;
-                }
-#else
-                if (q->proc[i]->priority < q->proc[highest_priority_idx]->priority) {
-                        highest_priority_idx = i;
-                }
-#endif
-        }
-        
-        // Safety check
-        if (highest_priority_idx >= q->size || q->proc[highest_priority_idx] == NULL) {
-                return NULL;
-        }
-        
-        // Save the highest priority process
-        struct pcb_t * highest_proc = q->proc[highest_priority_idx];
-        
-        // Remove the process from the queue and shift other processes
-        for (int i = highest_priority_idx; i < q->size - 1; i++) {
-                q->proc[i] = q->proc[i + 1];
-        }
-        
+
+        struct pcb_t * proc = q->proc[q->head];
+        q->head++;
+        if (q->head == q->capacity) q->head = 0;
         q->size--;
-        return highest_proc;
+        return proc;
 }
 
+struct pcb_t * queue_at(struct queue_t * q, int i) {
+        if (q == NULL || i < 0 || i >= q->size) return NULL;
+        return q->proc[(q->head + i) % q->capacity];
+}
+
+int queue_remove(struct queue_t * q, struct pcb_t * proc) {
+        if (q == NULL || proc == NULL) return 0;
+        for (int i = 0; i < q->size; i++) {
+                if (queue_at(q, i) != proc) continue;
+                /* Close the gap by moving the later processes forward */
+                for (int k = i; k < q->size - 1; k++) {
+                        q->proc[(q->head + k) % q->capacity] =
+                                q->proc[(q->head + k + 1) % q->capacity];
+                }
+                q->size--;
+                return 1;
+        }
+        return 0;
+}
@@ -1,147 +1,602 @@
 #include "queue.h"
 #include "sched.h"
+#include "timer.h"
 #include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
 
 // Sử dụng mutex để bảo vệ truy cập vào các hàng đợi
 static pthread_mutex_t queue_lock;
 
 static struct queue_t ready_queue;
 static struct queue_t run_queue;
+#ifndef MLQ_SCHED
 static struct queue_t running_list;
+#endif
 
 #ifdef MLQ_SCHED
-struct queue_t mlq_ready_queue[MAX_PRIO];
 static int slot[MAX_PRIO];
 
-// Các biến trạng thái dùng cho MLQ round-robin
-// current_prio : chỉ số của queue hiện tại được xử lý (0 có ưu tiên cao nhất)
-// current_slot_usage : số slot đã được dùng tại current_prio
-static int current_prio = 0;
-static int current_slot_usage = 0;
+/* Occupancy bitmap of the priority levels: bit [prio] is set while
+ * mlq_ready_queue[prio] is not empty */
+#define PRIO_WORDS ((MAX_PRIO + 63) / 64)
+
+/* Completely fair scheduling: every CPU keeps a min-heap of its ready
+ * processes keyed by weighted virtual runtime. A process of weight w
+ * ages by CFS_NICE0_VRUNTIME * CFS_NICE0_WEIGHT / w for every slot it
+ * runs, so the 40 nice steps the MAX_PRIO levels fold into share the
+ * CPUs 1.25x apart, as in Linux. */
+#define CFS_NICE0_WEIGHT 1024
+#define CFS_NICE0_VRUNTIME (1ULL << 20)
+#define CFS_NICE_LEVELS 40
+
+static enum sched_policy_t policy = SCHED_MLQ;
+static uint64_t cfs_weight[MAX_PRIO];
+
+/* Per-CPU run queue. Every CPU runs the policy on its own ready
+ * processes under its own lock; a CPU with nothing ready steals from
+ * the peer holding the most ready processes. */
+struct cpu_rq_t {
+    pthread_mutex_t lock;
+    // SCHED_MLQ: one FIFO per priority level
+    struct queue_t mlq_ready_queue[MAX_PRIO];
+    struct queue_t running_list;    // Processes dispatched on this CPU
+    struct pcb_t ** pool;           // Initial storage of the levels
+    atomic_int nr_ready;            // Read without the lock to pick victims
+    uint64_t prio_map[PRIO_WORDS];
+    // current_prio : chỉ số của queue hiện tại được xử lý (0 có ưu tiên cao nhất)
+    // current_slot_usage : số slot đã được dùng tại current_prio
+    int current_prio;
+    int current_slot_usage;
+    // SCHED_CFS: min-heap on (vruntime, pid)
+    struct pcb_t ** cfs_heap;
+    int cfs_size;
+    int cfs_capacity;
+    uint64_t min_vruntime;          // Never goes backwards
+};
+
+static struct cpu_rq_t * cpu_rq = NULL;
+static int nr_cpu_rq = 0;
+
+/* Admission queue. The loader pushes new processes on a lock-free
+ * stack linked through admit_next; the first get_proc/put_proc that
+ * finds it non-empty takes the whole batch at once, puts it back in arrival
+ * order and spreads it round-robin over the CPUs. Batches are placed
+ * one at a time so placement only depends on arrival order. */
+static _Atomic(struct pcb_t *) admit_head = NULL;
+static atomic_int nr_admitting = 0;
+
+// Processes added and not finished or killed yet
+static atomic_int nr_live = 0;
+static pthread_mutex_t admit_lock = PTHREAD_MUTEX_INITIALIZER;
+static int next_rq = 0;             // Round-robin placement, under admit_lock
 #endif
 
+#ifdef SCHED_STATS
+static atomic_ulong lock_acquired = 0;
+static atomic_ulong lock_contended = 0;
+static atomic_ulong nr_steals = 0;
+
+/* CPU time of every finished process, for the share report */
+struct proc_share_t {
+    uint32_t pid;
+    uint32_t prio;
+    uint64_t run_slots;
+    uint64_t lifetime;              // Slots from admission to finish
+};
+static pthread_mutex_t share_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct proc_share_t * shares = NULL;
+static int nr_shares = 0;
+static int shares_capacity = 0;
+/* Past the first SHARES_MAX processes only totals are kept, so long
+ * runs do not grow with the number of processes */
+#define SHARES_MAX 4096
+static unsigned long nr_more_shares = 0;
+static uint64_t more_run_slots = 0, more_lifetime = 0;
+static int record_shares = 1;
+#endif
+
+#ifdef MLQ_SCHED
+static void rq_lock(struct cpu_rq_t * rq) {
+#ifdef SCHED_STATS
+    atomic_fetch_add(&lock_acquired, 1);
+    if (pthread_mutex_trylock(&rq->lock) == 0) return;
+    atomic_fetch_add(&lock_contended, 1);
+#endif
+    pthread_mutex_lock(&rq->lock);
+}
+
+static void rq_unlock(struct cpu_rq_t * rq) {
+    pthread_mutex_unlock(&rq->lock);
+}
+
+/* First non-empty level at or after [prio], MAX_PRIO if there is none */
+static int prio_next(struct cpu_rq_t * rq, int prio) {
+    int w = prio / 64;
+    if (prio >= MAX_PRIO)
+        return MAX_PRIO;
+    uint64_t bits = rq->prio_map[w] & (~0ULL << (prio % 64));
+    while (bits == 0) {
+        if (++w == PRIO_WORDS)
+            return MAX_PRIO;
+        bits = rq->prio_map[w];
+    }
+    return w * 64 + __builtin_ctzll(bits);
+}
+
+/* Keep the bit of [prio] in step with its queue after a change */
+static void prio_update(struct cpu_rq_t * rq, int prio) {
+    if (empty(&rq->mlq_ready_queue[prio]))
+        rq->prio_map[prio / 64] &= ~(1ULL << (prio % 64));
+    else
+        rq->prio_map[prio / 64] |= 1ULL << (prio % 64);
+}
+
+static int cfs_before(struct pcb_t * a, struct pcb_t * b) {
+    if (a->vruntime != b->vruntime)
+        return a->vruntime < b->vruntime;
+    return a->pid < b->pid;
+}
+
+static void cfs_sift_down(struct cpu_rq_t * rq, int i) {
+    struct pcb_t ** heap = rq->cfs_heap;
+    while (1) {
+        int min = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < rq->cfs_size && cfs_before(heap[l], heap[min])) min = l;
+        if (r < rq->cfs_size && cfs_before(heap[r], heap[min])) min = r;
+        if (min == i) break;
+        struct pcb_t * tmp = heap[i];
+        heap[i] = heap[min];
+        heap[min] = tmp;
+        i = min;
+    }
+}
+
+/* Insert [proc] into the heap of [rq]. The caller holds rq->lock. */
+static void cfs_push(struct cpu_rq_t * rq, struct pcb_t * proc) {
+    if (rq->cfs_size == rq->cfs_capacity) {
+        rq->cfs_capacity = (rq->cfs_capacity == 0) ? QUEUE_INIT_CAP : 2 * rq->cfs_capacity;
+        rq->cfs_heap = realloc(rq->cfs_heap, rq->cfs_capacity * sizeof(struct pcb_t *));
+    }
+    int i = rq->cfs_size++;
+    while (i > 0 && cfs_before(proc, rq->cfs_heap[(i - 1) / 2])) {
+        rq->cfs_heap[i] = rq->cfs_heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    rq->cfs_heap[i] = proc;
+}
+
+/* Take the process with the least vruntime. The caller holds rq->lock. */
+static struct pcb_t * cfs_pop(struct cpu_rq_t * rq) {
+    if (rq->cfs_size == 0)
+        return NULL;
+    struct pcb_t * proc = rq->cfs_heap[0];
+    rq->cfs_heap[0] = rq->cfs_heap[--rq->cfs_size];
+    cfs_sift_down(rq, 0);
+    if (proc->vruntime > rq->min_vruntime)
+        rq->min_vruntime = proc->vruntime;
+    return proc;
+}
+
+/* Charge [proc] for the slots it ran since it was dispatched */
+static void cfs_account(struct pcb_t * proc) {
+    uint64_t ran = proc->run_slots - proc->vr_mark;
+    proc->vruntime += ran * CFS_NICE0_VRUNTIME * CFS_NICE0_WEIGHT / cfs_weight[proc->prio];
+    proc->vr_mark = proc->run_slots;
+}
+#endif
+
+int sched_policy_from_name(const char * name) {
+    if (!strcmp(name, "mlq"))
+        return SCHED_MLQ;
+#ifdef MLQ_SCHED
+    if (!strcmp(name, "cfs"))
+        return SCHED_CFS;
+#endif
+    return -1;
+}
+
 int queue_empty(void) {
 #ifdef MLQ_SCHED
-    unsigned long prio;
-    for (prio = 0; prio < MAX_PRIO; prio++) {
-        if (!empty(&mlq_ready_queue[prio]))
+    int cpu;
+    if (atomic_load(&nr_admitting) > 0)
+        return -1;
+    for (cpu = 0; cpu < nr_cpu_rq; cpu++) {
+        if (atomic_load(&cpu_rq[cpu].nr_ready) > 0)
             return -1;
     }
 #endif
     return (empty(&ready_queue) && empty(&run_queue));
 }
 
-void init_scheduler(void) {
+void init_scheduler(int nr_cpus, enum sched_policy_t sched_policy) {
 #ifdef MLQ_SCHED
-    int i;
+    int i, cpu;
     for (i = 0; i < MAX_PRIO; i++) {
-        mlq_ready_queue[i].size = 0;
         // Số slot cấp cho mỗi mức ưu tiên: càng cao (prio nhỏ) thì slot càng nhiều
         slot[i] = MAX_PRIO - i;
     }
+    /* Weights of the nice levels: 1024 at nice 0, 1.25x per step */
+    uint64_t nice_weight[CFS_NICE_LEVELS];
+    nice_weight[CFS_NICE_LEVELS / 2] = CFS_NICE0_WEIGHT;
+    for (i = CFS_NICE_LEVELS / 2 + 1; i < CFS_NICE_LEVELS; i++)
+        nice_weight[i] = nice_weight[i - 1] * 4 / 5;
+    for (i = CFS_NICE_LEVELS / 2 - 1; i >= 0; i--)
+        nice_weight[i] = nice_weight[i + 1] * 5 / 4;
+    for (i = 0; i < MAX_PRIO; i++)
+        cfs_weight[i] = nice_weight[i * CFS_NICE_LEVELS / MAX_PRIO];
+    policy = sched_policy;
+#ifdef SCHED_STATS
+    atomic_store(&lock_acquired, 0);
+    atomic_store(&lock_contended, 0);
+    atomic_store(&nr_steals, 0);
+    nr_shares = 0;
+#endif
+    nr_cpu_rq = (nr_cpus < 1) ? 1 : nr_cpus;
+    next_rq = 0;
+    cpu_rq = (struct cpu_rq_t *)calloc(nr_cpu_rq, sizeof(struct cpu_rq_t));
+    for (cpu = 0; cpu < nr_cpu_rq; cpu++) {
+        struct cpu_rq_t * rq = &cpu_rq[cpu];
+        // Levels start on slices of one per-CPU pool
+        rq->pool = malloc(MAX_PRIO * QUEUE_INIT_CAP * sizeof(struct pcb_t *));
+        for (i = 0; i < MAX_PRIO; i++)
+            queue_init(&rq->mlq_ready_queue[i], rq->pool + i * QUEUE_INIT_CAP,
+                       QUEUE_INIT_CAP);
+        pthread_mutex_init(&cpu_rq[cpu].lock, NULL);
+        atomic_init(&cpu_rq[cpu].nr_ready, 0);
+    }
 #endif
-    ready_queue.size = 0;
-    run_queue.size = 0;
+    queue_init(&ready_queue, NULL, 0);
+    queue_init(&run_queue, NULL, 0);
     pthread_mutex_init(&queue_lock, NULL);
 }
 
+void finish_scheduler(void) {
+#ifdef SCHED_STATS
+    fprintf(stderr, "sched: %lu lock acquisitions, %lu contended, %lu steals\n",
+            atomic_load(&lock_acquired), atomic_load(&lock_contended),
+            atomic_load(&nr_steals));
+    for (int i = 0; i < nr_shares; i++) {
+        fprintf(stderr, "sched: pid %u prio %u ran %lu of %lu slots, %.1f%% CPU share\n",
+                shares[i].pid, shares[i].prio, shares[i].run_slots, shares[i].lifetime,
+                100.0 * shares[i].run_slots / shares[i].lifetime);
+    }
+    if (nr_more_shares > 0) {
+        fprintf(stderr, "sched: %lu more processes ran %lu of %lu slots, %.1f%% CPU share\n",
+                nr_more_shares, (unsigned long)more_run_slots, (unsigned long)more_lifetime,
+                100.0 * more_run_slots / more_lifetime);
+    }
+    free(shares);
+    shares = NULL;
+    nr_shares = shares_capacity = 0;
+    nr_more_shares = 0;
+    more_run_slots = more_lifetime = 0;
+#endif
+#ifdef MLQ_SCHED
+    int cpu, i;
+    for (cpu = 0; cpu < nr_cpu_rq; cpu++) {
+        struct cpu_rq_t * rq = &cpu_rq[cpu];
+        for (i = 0; i < MAX_PRIO; i++)
+            queue_free(&rq->mlq_ready_queue[i]);
+        queue_free(&rq->running_list);
+        free(rq->pool);
+        free(rq->cfs_heap);
+        pthread_mutex_destroy(&rq->lock);
+    }
+    free(cpu_rq);
+    cpu_rq = NULL;
+    nr_cpu_rq = 0;
+#endif
+    queue_free(&ready_queue);
+    queue_free(&run_queue);
+    pthread_mutex_destroy(&queue_lock);
+}
+
 #ifdef MLQ_SCHED
 /*
  * get_mlq_proc: Lấy một tiến trình từ mlq_ready_queue dựa trên chính sách MLQ với
  * round-robin theo slot. Nếu queue tại current_prio có tiến trình và chưa tiêu thụ
  * hết slot, tiến trình sẽ được lấy ra và current_slot_usage được tăng. Nếu hết slot,
  * chuyển sang mức ưu tiên tiếp theo.
+ * The caller holds rq->lock.
  */
-struct pcb_t * get_mlq_proc(void) {
+static struct pcb_t * get_mlq_proc(struct cpu_rq_t * rq) {
     struct pcb_t * proc = NULL;
-    
-    pthread_mutex_lock(&queue_lock);
 
     // Bước 1: Kiểm tra xem có tiến trình nào ở mức ưu tiên cao hơn (prio nhỏ hơn)
     // so với current_prio hay không. Nếu có, chuyển current_prio về mức đó và reset slot.
-    for (int pr = 0; pr < current_prio; pr++) {
-        if (!empty(&mlq_ready_queue[pr])) {
-            current_prio = pr;
-            current_slot_usage = 0;
-            break;
+    int pr = prio_next(rq, 0);
+    if (pr >= MAX_PRIO)
+        return NULL;
+    if (pr < rq->current_prio) {
+        rq->current_prio = pr;
+        rq->current_slot_usage = 0;
+    }
+
+    // Bước 2: Nếu hàng đợi hiện tại rỗng thì chuyển sang hàng đợi khác rỗng kế tiếp
+    // và reset slot. Sau bước 1 không còn mức nào thấp hơn current_prio có tiến trình.
+    pr = prio_next(rq, rq->current_prio);
+    if (pr != rq->current_prio) {
+        rq->current_prio = pr;
+        rq->current_slot_usage = 0;
+    }
+    proc = dequeue(&rq->mlq_ready_queue[pr]);
+    prio_update(rq, pr);
+    rq->current_slot_usage++; // tiêu thụ 1 slot
+
+    // Nếu đã dùng đủ slot của hàng đợi hiện tại thì chuyển qua hàng đợi tiếp theo
+    if (rq->current_slot_usage >= slot[pr]) {
+        rq->current_prio = (pr + 1) % MAX_PRIO;
+        rq->current_slot_usage = 0;
+    }
+
+    if (proc != NULL)
+        atomic_fetch_sub(&rq->nr_ready, 1);
+    return proc;
+}
+
+/* Take the highest priority process of the busiest peer of [cpu] */
+static struct pcb_t * steal_mlq_proc(int cpu) {
+    struct pcb_t * proc = NULL;
+    int victim = -1, most = 0;
+
+    for (int i = 0; i < nr_cpu_rq; i++) {
+        int n = atomic_load(&cpu_rq[i].nr_ready);
+        if (i != cpu && n > most) {
+            most = n;
+            victim = i;
         }
     }
-    
-    int checked = 0;
-    // Bước 2: Duyệt qua các hàng đợi theo thứ tự (vòng tròn) để tìm tiến trình
-    while (checked < MAX_PRIO) {
-        if (!empty(&mlq_ready_queue[current_prio])) {
-            proc = dequeue(&mlq_ready_queue[current_prio]);
-            current_slot_usage++; // tiêu thụ 1 slot
-            
-            // Nếu đã dùng đủ slot của hàng đợi hiện tại thì chuyển qua hàng đợi tiếp theo
-            if (current_slot_usage >= slot[current_prio]) {
-                current_prio = (current_prio + 1) % MAX_PRIO;
-                current_slot_usage = 0;
-            }
-            break;
-        } else {
-            // Nếu hàng đợi hiện tại rỗng thì chuyển sang hàng đợi kế tiếp và reset slot
-            current_prio = (current_prio + 1) % MAX_PRIO;
-            current_slot_usage = 0;
+    if (victim < 0)
+        return NULL;
+
+    struct cpu_rq_t * rq = &cpu_rq[victim];
+    rq_lock(rq);
+    int pr = prio_next(rq, 0);
+    if (policy == SCHED_CFS) {
+        proc = cfs_pop(rq);
+        if (proc != NULL) {
+            // Keep only the lead over the victim, the thief adds its own base
+            proc->vruntime = (proc->vruntime > rq->min_vruntime)
+                ? proc->vruntime - rq->min_vruntime : 0;
+            atomic_fetch_sub(&rq->nr_ready, 1);
         }
-        checked++;
+    } else if (pr < MAX_PRIO) {
+        proc = dequeue(&rq->mlq_ready_queue[pr]);
+        prio_update(rq, pr);
+        atomic_fetch_sub(&rq->nr_ready, 1);
     }
-    
-    pthread_mutex_unlock(&queue_lock);
+    rq_unlock(rq);
+#ifdef SCHED_STATS
+    if (proc != NULL)
+        atomic_fetch_add(&nr_steals, 1);
+#endif
     return proc;
 }
 
-void put_mlq_proc(struct pcb_t * proc) {
-    pthread_mutex_lock(&queue_lock);
-    enqueue(&mlq_ready_queue[proc->prio], proc);
-    pthread_mutex_unlock(&queue_lock);
+/* Queue [proc] on the levels of [rq]. The caller holds rq->lock. */
+static void put_mlq_proc(struct cpu_rq_t * rq, struct pcb_t * proc) {
+    proc->ready_queue = &ready_queue;
+    proc->mlq_ready_queue = rq->mlq_ready_queue;
+    proc->running_list = &rq->running_list;
+    if (policy == SCHED_CFS) {
+        cfs_push(rq, proc);
+    } else {
+        enqueue(&rq->mlq_ready_queue[proc->prio], proc);
+        prio_update(rq, proc->prio);
+    }
+    atomic_fetch_add(&rq->nr_ready, 1);
 }
 
-void add_mlq_proc(struct pcb_t * proc) {
-    pthread_mutex_lock(&queue_lock);
-    enqueue(&mlq_ready_queue[proc->prio], proc);
-    pthread_mutex_unlock(&queue_lock);
+/* Next process to dispatch from [rq]. The caller holds rq->lock. */
+static struct pcb_t * pick_proc(struct cpu_rq_t * rq) {
+    if (policy != SCHED_CFS)
+        return get_mlq_proc(rq);
+    struct pcb_t * proc = cfs_pop(rq);
+    if (proc != NULL)
+        atomic_fetch_sub(&rq->nr_ready, 1);
+    return proc;
 }
 
-struct pcb_t * get_proc(void) {
-    return get_mlq_proc();
+/* Place every process waiting for admission on a run queue */
+static void admit_procs(void) {
+    if (atomic_load(&admit_head) == NULL)
+        return;
+    // Another CPU is placing a batch, the processes will show up there
+    if (pthread_mutex_trylock(&admit_lock) != 0)
+        return;
+
+    struct pcb_t * batch = atomic_exchange(&admit_head, NULL);
+    struct pcb_t * ordered = NULL;
+    while (batch != NULL) {
+        struct pcb_t * next = batch->admit_next;
+        batch->admit_next = ordered;
+        ordered = batch;
+        batch = next;
+    }
+
+    while (ordered != NULL) {
+        struct pcb_t * proc = ordered;
+        struct cpu_rq_t * rq = &cpu_rq[next_rq];
+        ordered = proc->admit_next;
+        next_rq = (next_rq + 1) % nr_cpu_rq;
+        rq_lock(rq);
+        // A newcomer starts level with the most starved process of the CPU
+        proc->vruntime = rq->min_vruntime;
+        put_mlq_proc(rq, proc);
+        rq_unlock(rq);
+        atomic_fetch_sub(&nr_admitting, 1);
+    }
+    pthread_mutex_unlock(&admit_lock);
 }
 
-void put_proc(struct pcb_t * proc) {
+struct pcb_t * get_proc(int cpu) {
+    struct cpu_rq_t * rq = &cpu_rq[cpu];
+
+    admit_procs();
+    rq_lock(rq);
+    struct pcb_t * proc = pick_proc(rq);
+    if (proc != NULL)
+        enqueue(&rq->running_list, proc);
+    rq_unlock(rq);
+    if (proc != NULL)
+        return proc;
+
+    // Hàng đợi cục bộ rỗng: lấy tiến trình từ CPU bận nhất
+    proc = steal_mlq_proc(cpu);
+    if (proc != NULL) {
+        rq_lock(rq);
+        if (policy == SCHED_CFS)
+            proc->vruntime += rq->min_vruntime;
+        proc->mlq_ready_queue = rq->mlq_ready_queue;
+        proc->running_list = &rq->running_list;
+        enqueue(&rq->running_list, proc);
+        rq_unlock(rq);
+    }
+    return proc;
+}
+
+void put_proc(int cpu, struct pcb_t * proc) {
     if (proc == NULL) return;
-    proc->ready_queue = &ready_queue;
-    proc->mlq_ready_queue = mlq_ready_queue;
-    proc->running_list = &running_list;
-    
-    // Lưu tiến trình vào danh sách running (cho mục đích bookkeeping)
-    pthread_mutex_lock(&queue_lock);
-    enqueue(&running_list, proc);
-    pthread_mutex_unlock(&queue_lock);
-    
-    // Đưa tiến trình trở lại mlq_ready_queue sau 1 time-slice
-    put_mlq_proc(proc);
+    struct cpu_rq_t * rq = &cpu_rq[cpu];
+
+    // Processes admitted earlier queue up ahead of the preempted one
+    admit_procs();
+    // Đưa tiến trình từ running_list trở lại mlq_ready_queue sau 1 time-slice
+    rq_lock(rq);
+    queue_remove(&rq->running_list, proc);
+    if (policy == SCHED_CFS)
+        cfs_account(proc);
+    put_mlq_proc(rq, proc);
+    rq_unlock(rq);
 }
 
 void add_proc(struct pcb_t * proc) {
     if (proc == NULL) return;
-    proc->ready_queue = &ready_queue;
-    proc->mlq_ready_queue = mlq_ready_queue;
-    proc->running_list = &running_list;
-    
-    // Lưu tiến trình vào danh sách running trước khi đưa vào mlq_ready_queue
-    pthread_mutex_lock(&queue_lock);
-    enqueue(&running_list, proc);
-    pthread_mutex_unlock(&queue_lock);
-    
-    add_mlq_proc(proc);
+
+    proc->run_slots = 0;
+    proc->admit_time = current_time();
+    proc->vr_mark = 0;
+    atomic_fetch_add(&nr_live, 1);
+    atomic_fetch_add(&nr_admitting, 1);
+    struct pcb_t * head = atomic_load(&admit_head);
+    do {
+        proc->admit_next = head;
+    } while (!atomic_compare_exchange_weak(&admit_head, &head, proc));
+}
+
+void finish_proc(int cpu, struct pcb_t * proc) {
+    if (proc == NULL) return;
+    struct cpu_rq_t * rq = &cpu_rq[cpu];
+
+    rq_lock(rq);
+    queue_remove(&rq->running_list, proc);
+    rq_unlock(rq);
+    atomic_fetch_sub(&nr_live, 1);
+#ifdef SCHED_STATS
+    if (!record_shares) return;
+    pthread_mutex_lock(&share_lock);
+    if (nr_shares == SHARES_MAX) {
+        nr_more_shares++;
+        more_run_slots += proc->run_slots;
+        more_lifetime += current_time() - proc->admit_time + 1;
+        pthread_mutex_unlock(&share_lock);
+        return;
+    }
+    if (nr_shares == shares_capacity) {
+        shares_capacity = (shares_capacity == 0) ? 64 : 2 * shares_capacity;
+        shares = realloc(shares, shares_capacity * sizeof(struct proc_share_t));
+    }
+    shares[nr_shares].pid = proc->pid;
+    shares[nr_shares].prio = proc->prio;
+    shares[nr_shares].run_slots = proc->run_slots;
+    shares[nr_shares].lifetime = current_time() - proc->admit_time + 1;
+    nr_shares++;
+    pthread_mutex_unlock(&share_lock);
+#endif
+}
+
+void sched_record_shares(int on) {
+#ifdef SCHED_STATS
+    record_shares = on;
+#endif
+}
+
+/* Keep a killed process for reaping, [victims] grows as needed */
+static void add_victim(struct pcb_t *** victims, int * capacity, int killed,
+        struct pcb_t * proc) {
+    if (killed == *capacity) {
+        *capacity = (*capacity == 0) ? 16 : 2 * *capacity;
+        *victims = realloc(*victims, *capacity * sizeof(struct pcb_t *));
+    }
+    (*victims)[killed] = proc;
+}
+
+int kill_procs(const char * path, void (*reap)(struct pcb_t * proc)) {
+    struct pcb_t ** victims = NULL;
+    int killed = 0, capacity = 0;
+
+    for (int cpu = 0; cpu < nr_cpu_rq; cpu++) {
+        struct cpu_rq_t * rq = &cpu_rq[cpu];
+        rq_lock(rq);
+        if (policy == SCHED_CFS) {
+            int kept = 0;
+            for (int i = 0; i < rq->cfs_size; i++) {
+                struct pcb_t * proc = rq->cfs_heap[i];
+                if (strcmp(proc->path, path) == 0) {
+                    proc->priority = -1;
+                    atomic_fetch_sub(&rq->nr_ready, 1);
+                    add_victim(&victims, &capacity, killed, proc);
+                    killed++;
+                } else {
+                    rq->cfs_heap[kept++] = proc;
+                }
+            }
+            rq->cfs_size = kept;
+            for (int i = kept / 2 - 1; i >= 0; i--)
+                cfs_sift_down(rq, i);
+        }
+        for (int lvl = prio_next(rq, 0); lvl < MAX_PRIO; lvl = prio_next(rq, lvl + 1)) {
+            struct queue_t * queue = &rq->mlq_ready_queue[lvl];
+            int idx = 0;
+            while (idx < queue->size) {
+                struct pcb_t * proc = queue_at(queue, idx);
+                if (strcmp(proc->path, path) == 0) {
+                    proc->priority = -1;
+                    queue_remove(queue, proc);
+                    atomic_fetch_sub(&rq->nr_ready, 1);
+                    add_victim(&victims, &capacity, killed, proc);
+                    killed++;
+                } else {
+                    idx++;
+                }
+            }
+            prio_update(rq, lvl);
+        }
+        rq_unlock(rq);
+    }
+    atomic_fetch_sub(&nr_live, killed);
+
+    /* Nobody can reach the victims any more, tear them down unlocked */
+    for (int i = 0; reap != NULL && i < killed; i++)
+        reap(victims[i]);
+    free(victims);
+    return killed;
+}
+
+int live_procs(void) {
+    return atomic_load(&nr_live);
+}
+
+int ready_procs(int cpu) {
+    return atomic_load(&cpu_rq[cpu].nr_ready);
 }
 #else
 // Phần else cho chế độ scheduler không MLQ (không cần thay đổi)
-struct pcb_t * get_proc(void) {
+struct pcb_t * get_proc(int cpu) {
     struct pcb_t * proc = NULL;
     pthread_mutex_lock(&queue_lock);
     if (!empty(&ready_queue))
@@ -152,7 +607,7 @@ struct pcb_t * get_proc(void) {
     return proc;
 }
 
-void put_proc(struct pcb_t * proc) {
+void put_proc(int cpu, struct pcb_t * proc) {
     proc->ready_queue = &ready_queue;
     proc->running_list = &running_list;
 
@@ -173,5 +628,22 @@ void add_proc(struct pcb_t * proc) {
     enqueue(&ready_queue, proc);
     pthread_mutex_unlock(&queue_lock);    
 }
-#endif
 
+void finish_proc(int cpu, struct pcb_t * proc) {
+}
+
+void sched_record_shares(int on) {
+}
+
+int kill_procs(const char * path, void (*reap)(struct pcb_t * proc)) {
+    return 0;
+}
+
+int live_procs(void) {
+    return 0;
+}
+
+int ready_procs(int cpu) {
+    return 0;
+}
+#endif
@@ -12,11 +12,10 @@
 #include "syscall.h"
 #include "stdio.h"
 #include "libmem.h"
-#include "queue.h"
+#include "sched.h"
+#include "loader.h"
 #include "string.h"
 
-extern struct queue_t mlq_ready_queue[MAX_PRIO];
-
 int __sys_killall(struct pcb_t *caller, struct sc_regs* regs)
 {
     char proc_name[100];
@@ -29,12 +28,13 @@ int __sys_killall(struct pcb_t *caller, struct sc_regs* regs)
     //proc_name = libread..
     int i = 0;
     data = 0;
-    while(data != -1){
+    while(data != -1 && i < sizeof(proc_name) - 1){
         libread(caller, memrg, i, &data);
         proc_name[i]= data;
         if(data == -1) proc_name[i]='\0';
         i++;
     }
+    proc_name[i] = '\0';
     printf("The procname retrieved from memregionid %d is \"%s\"\n", memrg, proc_name);
 
     /* TODO: Traverse proclist to terminate the proc
@@ -48,32 +48,7 @@ int __sys_killall(struct pcb_t *caller, struct sc_regs* regs)
      *        name in var proc_name
      */
 
-    int killed = 0;
-
-    for (int lvl = 0; lvl < MAX_PRIO; lvl++)
-    {
-        struct queue_t *queue = &mlq_ready_queue[lvl];
-        int idx = 0;
-
-        while (idx < queue->size)
-        {
-            struct pcb_t *proc = queue->proc[idx];
-            if (strcmp(proc->path, proc_name) == 0)
-            {
-                proc->priority = -1;
-                killed++;
-
-                for (int k = idx; k < queue->size - 1; k++)
-                {
-                    queue->proc[k] = queue->proc[k + 1];
-                }
-                queue->size--;
-            }
-            else
-            {
-                idx++;
-            }
-        }
-    }
+    /* Killed processes give back their memory like finished ones */
+    int killed = kill_procs(proc_name, free_proc);
     return killed;
 }
@@ -27,7 +27,9 @@ int __sys_memmap(struct pcb_t *caller, struct sc_regs* regs)
             inc_vma_limit(caller, regs->a2, regs->a3);
             break;
    case SYSMEM_SWP_OP:
-            __mm_swap_page(caller, regs->a2, regs->a3);
+            /* Copy RAM frame a2 out to swap frame a3 */
+            if (__mm_swap_page(caller, regs->a2, regs->a3) < 0)
+               return -1;
             break;
    case SYSMEM_IO_READ:
             MEMPHY_read(caller->mram, regs->a2, &value);
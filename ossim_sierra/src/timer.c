@@ -1,12 +1,17 @@
-
 #include "timer.h"
+#include "evlog.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+#include <unistd.h>
 
 static pthread_t _timer;
 
 struct timer_id_container_t {
 	struct timer_id_t id;
+	atomic_int parked;	/* Device sleeps on [wake] until the slot opens */
+	sem_t wake;
 	struct timer_id_container_t * next;
 };
 
@@ -15,65 +20,126 @@ static struct timer_id_container_t * dev_list = NULL;
 static uint64_t _time;
 
 static int timer_started = 0;
-static int timer_stop = 0;
 
+/* Combining slot barrier.
+ * [barrier] packs the number of attached devices (high half) and the
+ * number of devices that still have to finish the current slot (low
+ * half) so that arrivals and detaches agree on a single winner: the
+ * device that drops the pending count to zero advances the clock and
+ * flips [slot_sense], which releases everybody waiting on the slot.
+ * The timer thread only waits for the last device to detach. */
+#define BARRIER_DEV	(1ULL << 32)
+#define BARRIER_PENDING(v)	((uint32_t)(v))
+#define BARRIER_NR_DEVS(v)	((uint32_t)((v) >> 32))
+
+static _Atomic uint64_t barrier = 0;
+static atomic_int slot_sense = 0;
+static sem_t timer_done;
+
+/* Idle-skip bookkeeping of the current slot: whether any device did
+ * real work, and the earliest wakeup asked by the idle ones */
+static atomic_int slot_busy = 0;
+static _Atomic uint64_t slot_wakeup = TIMER_NO_WAKEUP;
+
+static int spin_limit = 0;
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
 
-static void * timer_routine(void * args) {
-	while (!timer_stop) {
-		printf("Time slot %3lu\n", current_time());
-		int fsh = 0;
-		int event = 0;
-		/* Wait for all devices have done the job in current
-		 * time slot */
-		struct timer_id_container_t * temp;
-		for (temp = dev_list; temp != NULL; temp = temp->next) {
-			pthread_mutex_lock(&temp->id.event_lock);
-			while (!temp->id.done && !temp->id.fsh) {
-				pthread_cond_wait(
-					&temp->id.event_cond,
-					&temp->id.event_lock
-				);
-			}
-			if (temp->id.fsh) {
-				fsh++;
-			}
-			event++;
-			pthread_mutex_unlock(&temp->id.event_lock);
-		}
+/* Wait until the slot the device has just finished is over */
+static void wait_slot(struct timer_id_container_t * dev, int old_sense) {
+	int spin;
+	for (spin = 0; spin < spin_limit; spin++) {
+		if (atomic_load(&slot_sense) != old_sense) return;
+		cpu_relax();
+	}
+
+	/* Publish that we are going to sleep, then recheck the sense. If
+	 * the slot opened in between, whoever clears [parked] first owns
+	 * the wakeup: either we cancel the sleep or we eat the post. */
+	atomic_store(&dev->parked, 1);
+	if (atomic_load(&slot_sense) != old_sense &&
+	    atomic_exchange(&dev->parked, 0) == 1) {
+		return;
+	}
+	while (sem_wait(&dev->wake) != 0)
+		;
+}
+
+/* Called by the device that completed the barrier of the current slot */
+static void advance_slot(uint32_t nr_devs) {
+	struct timer_id_container_t * temp;
 
-		/* Increase the time slot */
+	if (nr_devs == 0) {
+		/* Every device has detached, let the timer finish */
+		sem_post(&timer_done);
+		return;
+	}
+
+	/* Increase the time slot. If nobody has work, fast-forward to the
+	 * earliest wakeup while keeping the trace of every slot */
+	uint64_t next = _time + 1;
+	uint64_t wakeup = atomic_load(&slot_wakeup);
+	if (!atomic_load(&slot_busy) && wakeup != TIMER_NO_WAKEUP && wakeup > next) {
+		next = wakeup;
+	}
+	atomic_store(&slot_busy, 0);
+	atomic_store(&slot_wakeup, TIMER_NO_WAKEUP);
+	atomic_store(&barrier, nr_devs * BARRIER_DEV + nr_devs);
+	while (_time < next) {
 		_time++;
-		
-		/* Let devices continue their job */
-		for (temp = dev_list; temp != NULL; temp = temp->next) {
-			pthread_mutex_lock(&temp->id.timer_lock);
-			temp->id.done = 0;
-			pthread_cond_signal(&temp->id.timer_cond);
-			pthread_mutex_unlock(&temp->id.timer_lock);
-		}
-		if (fsh == event) {
-			break;
+		evlog(EV_SLOT, current_time(), 0, 0, NULL);
+	}
+
+	/* Let devices continue their job */
+	atomic_store(&slot_sense, !atomic_load(&slot_sense));
+	for (temp = dev_list; temp != NULL; temp = temp->next) {
+		if (atomic_load(&temp->parked) &&
+		    atomic_exchange(&temp->parked, 0) == 1) {
+			sem_post(&temp->wake);
 		}
 	}
+}
+
+static void * timer_routine(void * args) {
+	while (sem_wait(&timer_done) != 0)
+		;
+	_time++;
 	pthread_exit(args);
 }
 
-void next_slot(struct timer_id_t * timer_id) {
+static void end_slot(struct timer_id_t * timer_id) {
+	struct timer_id_container_t * dev =
+		(struct timer_id_container_t *)timer_id;
 	/* Tell to timer that we have done our job in current slot */
-	pthread_mutex_lock(&timer_id->event_lock);
-	timer_id->done = 1;
-	pthread_cond_signal(&timer_id->event_cond);
-	pthread_mutex_unlock(&timer_id->event_lock);
+	int old_sense = timer_id->sense;
+	timer_id->sense = !timer_id->sense;
+	uint64_t v = atomic_fetch_sub(&barrier, 1) - 1;
+	if (BARRIER_PENDING(v) == 0) {
+		advance_slot(BARRIER_NR_DEVS(v));
+		return;
+	}
 
 	/* Wait for going to next slot */
-	pthread_mutex_lock(&timer_id->timer_lock);
-	while (timer_id->done) {
-		pthread_cond_wait(
-			&timer_id->timer_cond,
-			&timer_id->timer_lock
-		);
+	wait_slot(dev, old_sense);
+}
+
+void next_slot(struct timer_id_t * timer_id) {
+	if (!atomic_load(&slot_busy)) {
+		atomic_store(&slot_busy, 1);
 	}
-	pthread_mutex_unlock(&timer_id->timer_lock);
+	end_slot(timer_id);
+}
+
+void next_slot_idle(struct timer_id_t * timer_id, uint64_t wakeup) {
+	uint64_t cur = atomic_load(&slot_wakeup);
+	while (wakeup < cur &&
+	       !atomic_compare_exchange_weak(&slot_wakeup, &cur, wakeup))
+		;
+	end_slot(timer_id);
 }
 
 uint64_t current_time() {
@@ -81,15 +147,36 @@ uint64_t current_time() {
 }
 
 void start_timer() {
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	uint32_t nr_devs = BARRIER_NR_DEVS(atomic_load(&barrier));
+	/* Spinning only pays off when no waiter steals the core of the
+	 * device it is waiting for */
+	spin_limit = (nr_devs <= ncpus) ? TIMER_SPIN_LIMIT : 0;
 	timer_started = 1;
+	sem_init(&timer_done, 0, (nr_devs == 0) ? 1 : 0);
+	evlog(EV_SLOT, current_time(), 0, 0, NULL);
 	pthread_create(&_timer, NULL, timer_routine, NULL);
 }
 
+void start_manual_timer() {
+	timer_started = 1;
+	evlog(EV_SLOT, current_time(), 0, 0, NULL);
+}
+
+void step_timer(uint64_t next) {
+	if (next <= _time) next = _time + 1;
+	while (_time < next) {
+		_time++;
+		evlog(EV_SLOT, current_time(), 0, 0, NULL);
+	}
+}
+
 void detach_event(struct timer_id_t * event) {
-	pthread_mutex_lock(&event->event_lock);
 	event->fsh = 1;
-	pthread_cond_signal(&event->event_cond);
-	pthread_mutex_unlock(&event->event_lock);
+	uint64_t v = atomic_fetch_sub(&barrier, BARRIER_DEV + 1) - (BARRIER_DEV + 1);
+	if (BARRIER_PENDING(v) == 0) {
+		advance_slot(BARRIER_NR_DEVS(v));
+	}
 }
 
 struct timer_id_t * attach_event() {
@@ -98,14 +185,13 @@ struct timer_id_t * attach_event() {
 	}else{
 		struct timer_id_container_t * container =
 			(struct timer_id_container_t*)malloc(
-				sizeof(struct timer_id_container_t)		
+				sizeof(struct timer_id_container_t)
 			);
-		container->id.done = 0;
 		container->id.fsh = 0;
-		pthread_cond_init(&container->id.event_cond, NULL);
-		pthread_mutex_init(&container->id.event_lock, NULL);
-		pthread_cond_init(&container->id.timer_cond, NULL);
-		pthread_mutex_init(&container->id.timer_lock, NULL);
+		container->id.sense = atomic_load(&slot_sense);
+		atomic_init(&container->parked, 0);
+		sem_init(&container->wake, 0, 0);
+		atomic_fetch_add(&barrier, BARRIER_DEV + 1);
 		if (dev_list == NULL) {
 			dev_list = container;
 			dev_list->next = NULL;
@@ -118,15 +204,12 @@ struct timer_id_t * attach_event() {
 }
 
 void stop_timer() {
-	timer_stop = 1;
 	pthread_join(_timer, NULL);
+	sem_destroy(&timer_done);
 	while (dev_list != NULL) {
 		struct timer_id_container_t * temp = dev_list;
 		dev_list = dev_list->next;
-		pthread_cond_destroy(&temp->id.event_cond);
-		pthread_mutex_destroy(&temp->id.event_lock);
-		pthread_cond_destroy(&temp->id.timer_cond);
-		pthread_mutex_destroy(&temp->id.timer_lock);
+		sem_destroy(&temp->wake);
 		free(temp);
 	}
-}
\ No newline at end of file
+}
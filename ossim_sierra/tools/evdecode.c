@@ -0,0 +1,83 @@
+/*
+ * Event log decoder
+ * Renders a binary event log written by 'os -l <file>' as the text
+ * trace the simulator prints by default. The writer stores the ring of
+ * every thread as it drains it, so events are put back in emission
+ * order before rendering.
+ *
+ * Usage: evdecode <event log>
+ */
+
+#include "evlog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct event_t {
+	uint64_t seq;
+	size_t idx;	/* Index of the event record in the log */
+};
+
+static int cmp_event(const void * a, const void * b) {
+	uint64_t x = ((const struct event_t *)a)->seq;
+	uint64_t y = ((const struct event_t *)b)->seq;
+	return (x > y) - (x < y);
+}
+
+int main(int argc, char * argv[]) {
+	if (argc != 2) {
+		printf("Usage: evdecode <event log>\n");
+		return 1;
+	}
+
+	FILE * file;
+	if ((file = fopen(argv[1], "rb")) == NULL) {
+		printf("Cannot open event log at %s\n", argv[1]);
+		return 1;
+	}
+	char magic[sizeof(EVLOG_MAGIC)] = { 0 };
+	uint32_t recsz = 0;
+	if (fread(magic, 1, strlen(EVLOG_MAGIC), file) != strlen(EVLOG_MAGIC) ||
+	    strcmp(magic, EVLOG_MAGIC) != 0 ||
+	    fread(&recsz, sizeof(recsz), 1, file) != 1 ||
+	    recsz != sizeof(struct evlog_rec_t)) {
+		printf("%s is not an event log of this simulator\n", argv[1]);
+		return 1;
+	}
+
+	/* Load every record */
+	size_t nrec = 0, cap = 1 << 16;
+	struct evlog_rec_t * rec = malloc(cap * sizeof(struct evlog_rec_t));
+	size_t n;
+	while ((n = fread(rec + nrec, sizeof(struct evlog_rec_t), cap - nrec, file)) > 0) {
+		nrec += n;
+		if (nrec == cap) {
+			cap *= 2;
+			rec = realloc(rec, cap * sizeof(struct evlog_rec_t));
+		}
+	}
+	fclose(file);
+
+	/* Index the events, skipping the text records that follow them */
+	size_t nev = 0;
+	struct event_t * ev = malloc((nrec + 1) * sizeof(struct event_t));
+	for (size_t i = 0; i < nrec; ) {
+		ev[nev].seq = rec[i].seq;
+		ev[nev].idx = i;
+		nev++;
+		i += 1 + (rec[i].len + sizeof(struct evlog_rec_t) - 1) / sizeof(struct evlog_rec_t);
+	}
+	qsort(ev, nev, sizeof(struct event_t), cmp_event);
+
+	for (size_t i = 0; i < nev; i++) {
+		struct evlog_rec_t * r = &rec[ev[i].idx];
+		if (ev[i].idx + 1 + (r->len + sizeof(*r) - 1) / sizeof(*r) > nrec) {
+			fprintf(stderr, "Truncated event log\n");
+			break;
+		}
+		evlog_render(stdout, r, (const char *)(r + 1));
+	}
+	free(ev);
+	free(rec);
+	return 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * Program compiler
+ * Converts a text process description into the compiled program format
+ * of loader.h, which the simulator maps instead of parsing. The output
+ * is written next to its final name and renamed over it, so simulators
+ * running the previous version keep their mapping intact.
+ *
+ * Usage: progc <program> <compiled program>
+ */
+
+#include "loader.h"
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char * argv[]) {
+	if (argc != 3) {
+		printf("Usage: progc <program> <compiled program>\n");
+		return 1;
+	}
+
+	struct pcb_t * proc = load(argv[1]);
+	struct code_seg_t * code = proc->code;
+
+	struct prog_hdr_t hdr;
+	memcpy(hdr.magic, PROG_MAGIC, sizeof(hdr.magic));
+	hdr.priority = proc->priority;
+	hdr.size = code->size;
+
+	size_t len = strlen(argv[2]);
+	char * tmp = malloc(len + 5);
+	snprintf(tmp, len + 5, "%s.tmp", argv[2]);
+	FILE * file;
+	if ((file = fopen(tmp, "wb")) == NULL) {
+		printf("Cannot write compiled program at %s\n", tmp);
+		return 1;
+	}
+	if (fwrite(&hdr, sizeof(hdr), 1, file) != 1 ||
+	    fwrite(code->text, sizeof(struct inst_t), code->size, file) != code->size ||
+	    fclose(file) != 0 ||
+	    rename(tmp, argv[2]) != 0) {
+		printf("Cannot write compiled program at %s\n", argv[2]);
+		remove(tmp);
+		return 1;
+	}
+
+	release_code(code);
+	flush_code_cache();
+	arena_release(proc->arena);
+	free(tmp);
+	return 0;
+}